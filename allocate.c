@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "lib.h"
 #include "allocate.h"
@@ -43,20 +44,32 @@
 #include "expression.h"
 #include "linearize.h"
 
+unsigned long alloc_bytes, alloc_peak_bytes;
+
 void protect_allocations(struct allocator_struct *desc)
 {
 	desc->blobs = NULL;
 }
 
+/*
+ * Free everything. The statistics are kept, they're thus
+ * cumulative (for example, the tokens of all the files).
+ */
 void drop_all_allocations(struct allocator_struct *desc)
 {
 	struct allocation_blob *blob = desc->blobs;
 
 	desc->blobs = NULL;
-	desc->allocations = 0;
-	desc->total_bytes = 0;
-	desc->useful_bytes = 0;
 	desc->freelist = NULL;
+	desc->mark.active = 0;
+	while (blob) {
+		struct allocation_blob *next = blob->next;
+		blob_free(blob, desc->chunking);
+		alloc_bytes -= desc->chunking;
+		blob = next;
+	}
+	blob = desc->spare;
+	desc->spare = NULL;
 	while (blob) {
 		struct allocation_blob *next = blob->next;
 		blob_free(blob, desc->chunking);
@@ -64,6 +77,64 @@ void drop_all_allocations(struct allocator_struct *desc)
 	}
 }
 
+/*
+ * Start an arena: everything allocated from now on can be
+ * released in one go by release_allocations().
+ * The freelist is put aside: the entries freed while the
+ * arena is active are simply forgotten when it's released.
+ */
+void mark_allocations(struct allocator_struct *desc)
+{
+	struct allocator_mark *mark = &desc->mark;
+	struct allocation_blob *blob = desc->blobs;
+
+	if (mark->active)
+		die("internal error: nested arena for '%s'", desc->name);
+	mark->active = 1;
+	mark->blob = blob;
+	mark->left = blob ? blob->left : 0;
+	mark->offset = blob ? blob->offset : 0;
+	mark->freelist = desc->freelist;
+	mark->allocations = desc->allocations;
+	mark->total_bytes = desc->total_bytes;
+	mark->useful_bytes = desc->useful_bytes;
+	desc->freelist = NULL;
+}
+
+/*
+ * Release everything allocated since mark_allocations().
+ * The blobs are not given back to the system but kept for
+ * the next allocations, cleared since allocate() must return
+ * zeroed memory.
+ */
+void release_allocations(struct allocator_struct *desc)
+{
+	struct allocator_mark *mark = &desc->mark;
+	struct allocation_blob *blob = desc->blobs;
+
+	if (!mark->active)
+		return;
+	while (blob != mark->blob) {
+		struct allocation_blob *next = blob->next;
+		memset(blob->data, 0, blob->offset);
+		blob->next = desc->spare;
+		desc->spare = blob;
+		alloc_bytes -= desc->chunking;
+		blob = next;
+	}
+	if (blob) {
+		memset(blob->data + mark->offset, 0, blob->offset - mark->offset);
+		blob->left = mark->left;
+		blob->offset = mark->offset;
+	}
+	desc->blobs = blob;
+	desc->freelist = mark->freelist;
+	desc->allocations = mark->allocations;
+	desc->total_bytes = mark->total_bytes;
+	desc->useful_bytes = mark->useful_bytes;
+	mark->active = 0;
+}
+
 void free_one_entry(struct allocator_struct *desc, void *entry)
 {
 	void **p = entry;
@@ -100,12 +171,19 @@ void *allocate(struct allocator_struct *desc, unsigned int size)
 	size = (size + alignment - 1) & ~(alignment-1);
 	if (!blob || blob->left < size) {
 		unsigned int offset, chunking = desc->chunking;
-		struct allocation_blob *newblob = blob_alloc(chunking);
+		struct allocation_blob *newblob = desc->spare;
+		if (newblob)
+			desc->spare = newblob->next;
+		else
+			newblob = blob_alloc(chunking);
 		if (!newblob)
 			die("out of memory");
 		if (size > chunking)
 			die("alloc too big");
 		desc->total_bytes += chunking;
+		alloc_bytes += chunking;
+		if (alloc_bytes > alloc_peak_bytes)
+			alloc_peak_bytes = alloc_bytes;
 		newblob->next = blob;
 		blob = newblob;
 		desc->blobs = newblob;
@@ -18,6 +18,16 @@ struct allocator_struct {
 	/* statistics */
 	unsigned int allocations;
 	unsigned long total_bytes, useful_bytes;
+	/* arena: the state saved by mark_allocations() */
+	struct allocator_mark {
+		struct allocation_blob *blob;
+		unsigned int left, offset;
+		void *freelist;
+		unsigned int allocations;
+		unsigned long total_bytes, useful_bytes;
+		int active;
+	} mark;
+	struct allocation_blob *spare;	/* released blobs, ready for reuse */
 };
 
 struct allocator_stats {
@@ -26,8 +36,13 @@ struct allocator_stats {
 	unsigned long total_bytes, useful_bytes;
 };
 
+// the bytes currently allocated by all the allocators and their peak
+extern unsigned long alloc_bytes, alloc_peak_bytes;
+
 extern void protect_allocations(struct allocator_struct *desc);
 extern void drop_all_allocations(struct allocator_struct *desc);
+extern void mark_allocations(struct allocator_struct *desc);
+extern void release_allocations(struct allocator_struct *desc);
 extern void *allocate(struct allocator_struct *desc, unsigned int size);
 extern void free_one_entry(struct allocator_struct *desc, void *entry);
 extern void show_allocations(struct allocator_struct *);
@@ -40,7 +55,9 @@ extern void show_allocation_stats(void);
 	extern void show_##x##_alloc(void);	\
 	extern void get_##x##_stats(struct allocator_stats *);		\
 	extern void clear_##x##_alloc(void);	\
-	extern void protect_##x##_alloc(void);
+	extern void protect_##x##_alloc(void);	\
+	extern void mark_##x##_alloc(void);	\
+	extern void release_##x##_alloc(void);
 #define DECLARE_ALLOCATOR(x) __DECLARE_ALLOCATOR(struct x, x)
 
 #define __DO_ALLOCATOR(type, objsize, objalign, objname, x)	\
@@ -71,6 +88,14 @@ extern void show_allocation_stats(void);
 	void protect_##x##_alloc(void)				\
 	{							\
 		protect_allocations(&x##_allocator);		\
+	}							\
+	void mark_##x##_alloc(void)				\
+	{							\
+		mark_allocations(&x##_allocator);		\
+	}							\
+	void release_##x##_alloc(void)				\
+	{							\
+		release_allocations(&x##_allocator);		\
 	}
 
 #define __ALLOCATOR(t, n, x) 					\
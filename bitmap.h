@@ -1,8 +1,12 @@
 #ifndef BITMAP_H
 #define BITMAP_H
 
+#include <stdbool.h>
+#include <string.h>
+
 #define BITS_IN_LONG	(sizeof(unsigned long)*8)
 #define LONGS(x)	((x + BITS_IN_LONG - 1) & -BITS_IN_LONG)
+#define BITS_TO_LONGS(nr)	(((nr) + BITS_IN_LONG - 1) / BITS_IN_LONG)
 
 /* Every bitmap gets its own type */
 #define DECLARE_BITMAP(name, x) unsigned long name[LONGS(x)]
@@ -48,4 +52,87 @@ static inline int test_and_clear_bit(unsigned int nr, unsigned long *bitmap)
 	return (old & mask) != 0;
 }
 
+/*
+ * Operations on whole bitmaps of 'nbits' bits,
+ * for bitmaps whose size is only known at runtime.
+ */
+static inline void bitmap_zero(unsigned long *dst, unsigned int nbits)
+{
+	memset(dst, 0, BITS_TO_LONGS(nbits) * sizeof(unsigned long));
+}
+
+static inline void bitmap_copy(unsigned long *dst, const unsigned long *src, unsigned int nbits)
+{
+	memcpy(dst, src, BITS_TO_LONGS(nbits) * sizeof(unsigned long));
+}
+
+static inline void bitmap_or(unsigned long *dst, const unsigned long *src1,
+	const unsigned long *src2, unsigned int nbits)
+{
+	unsigned int i, n = BITS_TO_LONGS(nbits);
+
+	for (i = 0; i < n; i++)
+		dst[i] = src1[i] | src2[i];
+}
+
+static inline void bitmap_and(unsigned long *dst, const unsigned long *src1,
+	const unsigned long *src2, unsigned int nbits)
+{
+	unsigned int i, n = BITS_TO_LONGS(nbits);
+
+	for (i = 0; i < n; i++)
+		dst[i] = src1[i] & src2[i];
+}
+
+static inline void bitmap_andnot(unsigned long *dst, const unsigned long *src1,
+	const unsigned long *src2, unsigned int nbits)
+{
+	unsigned int i, n = BITS_TO_LONGS(nbits);
+
+	for (i = 0; i < n; i++)
+		dst[i] = src1[i] & ~src2[i];
+}
+
+static inline bool bitmap_equal(const unsigned long *src1, const unsigned long *src2, unsigned int nbits)
+{
+	return !memcmp(src1, src2, BITS_TO_LONGS(nbits) * sizeof(unsigned long));
+}
+
+static inline bool bitmap_intersects(const unsigned long *src1, const unsigned long *src2, unsigned int nbits)
+{
+	unsigned int i, n = BITS_TO_LONGS(nbits);
+
+	for (i = 0; i < n; i++) {
+		if (src1[i] & src2[i])
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Return the index of the first bit set at or after 'nr',
+ * or 'nbits' if there is none.
+ */
+static inline unsigned int find_next_bit(const unsigned long *bitmap, unsigned int nbits, unsigned int nr)
+{
+	unsigned int offset = nr / BITS_IN_LONG;
+	unsigned long word;
+
+	if (nr >= nbits)
+		return nbits;
+	word = bitmap[offset] & (~0UL << (nr & (BITS_IN_LONG-1)));
+	while (!word) {
+		if (++offset >= BITS_TO_LONGS(nbits))
+			return nbits;
+		word = bitmap[offset];
+	}
+	nr = offset * BITS_IN_LONG + __builtin_ctzl(word);
+	return nr < nbits ? nr : nbits;
+}
+
+#define for_each_set_bit(bit, bitmap, nbits)			\
+	for ((bit) = find_next_bit(bitmap, nbits, 0);		\
+	     (bit) < (nbits);					\
+	     (bit) = find_next_bit(bitmap, nbits, (bit) + 1))
+
 #endif /* BITMAP_H */
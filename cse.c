@@ -3,6 +3,14 @@
  * see if we can simplify it and apply CSE on it.
  *
  * Copyright (C) 2004 Linus Torvalds
+ *
+ * This is done as a dominator-based value numbering: the dominator
+ * tree is walked depth-first and each instruction is looked up in
+ * a hash table holding the instructions of the blocks dominating
+ * the current one. If an identical instruction is found, it must
+ * dominate the current one which can thus be replaced by it.
+ * Otherwise the instruction is added to the table and removed from
+ * it when leaving the block.
  */
 
 #include <string.h>
@@ -19,8 +27,22 @@
 #include "flow.h"
 #include "cse.h"
 
-#define INSN_HASH_SIZE 256
-static struct instruction_list *insn_hash_table[INSN_HASH_SIZE];
+struct gvn_entry {
+	unsigned long hash;
+	struct instruction *insn;
+};
+
+// open-addressing table, with linear probing
+static struct gvn_entry *gvn_table;
+static unsigned int gvn_size, gvn_nr;
+
+// the entries of the table, in the order they were added
+static struct gvn_entry *gvn_scope;
+static unsigned int gvn_scope_size;
+
+// the blocks on the path from the root of the dominance tree
+// to the current block have this generation
+static unsigned long gvn_generation;
 
 static int phi_compare(pseudo_t phi1, pseudo_t phi2)
 {
@@ -35,7 +57,7 @@ static int phi_compare(pseudo_t phi1, pseudo_t phi2)
 }
 
 
-void cse_collect(struct instruction *insn)
+static int insn_hash(struct instruction *insn, unsigned long *hashp)
 {
 	unsigned long hash;
 
@@ -89,7 +111,7 @@ void cse_collect(struct instruction *insn)
 		break;
 
 	case OP_SETFVAL:
-		hash += hashval(insn->fvalue);
+		hash += hashval(*insn->fvalue);
 		break;
 
 	case OP_SEXT: case OP_ZEXT:
@@ -97,7 +119,7 @@ void cse_collect(struct instruction *insn)
 	case OP_PTRCAST:
 	case OP_UTPTR: case OP_PTRTU:
 		if (!insn->orig_type || insn->orig_type->bit_size < 0)
-			return;
+			return 0;
 		hash += hashval(insn->src);
 
 		// Note: see corresponding line in insn_compare()
@@ -123,11 +145,10 @@ void cse_collect(struct instruction *insn)
 		 * Nothing to do, don't even bother hashing them,
 		 * we're not going to try to CSE them
 		 */
-		return;
+		return 0;
 	}
-	hash += hash >> 16;
-	hash &= INSN_HASH_SIZE-1;
-	add_instruction(insn_hash_table + hash, insn);
+	*hashp = hash;
+	return 1;
 }
 
 /* Compare two (sorted) phi-lists */
@@ -230,7 +251,7 @@ static int insn_compare(const void *_i1, const void *_i2)
 		break;
 
 	case OP_SETFVAL:
-		diff = memcmp(&i1->fvalue, &i2->fvalue, sizeof(i1->fvalue));
+		diff = memcmp(i1->fvalue, i2->fvalue, sizeof(*i1->fvalue));
 		if (diff)
 			return diff;
 		break;
@@ -249,7 +270,7 @@ static int insn_compare(const void *_i1, const void *_i2)
 		// Note: if it can be guaranted that identical ->src
 		// implies identical orig_type->bit_size, then this
 		// test and the hashing of the original size in
-		// cse_collect() are not needed.
+		// insn_hash() are not needed.
 		// It must be generaly true but it isn't guaranted (yet).
 		size1 = i1->orig_type->bit_size;
 		size2 = i2->orig_type->bit_size;
@@ -265,18 +286,79 @@ static int insn_compare(const void *_i1, const void *_i2)
 	return 0;
 }
 
-static void sort_instruction_list(struct instruction_list **list)
-{
-	sort_list((struct ptr_list **)list , insn_compare);
-}
-
-static struct instruction * cse_one_instruction(struct instruction *insn, struct instruction *def)
+static void cse_one_instruction(struct instruction *insn, struct instruction *def)
 {
 	convert_instruction_target(insn, def->target);
 
 	kill_instruction(insn);
 	repeat_phase |= REPEAT_CSE;
-	return def;
+}
+
+static unsigned int gvn_slot(unsigned long hash, unsigned int size)
+{
+	// Fibonacci hashing: the low bits of the hash are poorly distributed
+	return (hash * 0x9E3779B97F4A7C15ULL) >> (64 - __builtin_ctz(size));
+}
+
+static void gvn_resize(unsigned int size)
+{
+	struct gvn_entry *old = gvn_table;
+	unsigned int i;
+
+	gvn_table = calloc(size, sizeof(*gvn_table));
+	if (!gvn_table)
+		die("out of memory");
+	gvn_size = size;
+
+	// reinsert in the original order, so that the entries can still
+	// be removed in the reverse order
+	for (i = 0; i < gvn_nr; i++) {
+		unsigned int slot = gvn_slot(gvn_scope[i].hash, size);
+
+		while (gvn_table[slot].insn)
+			slot = (slot + 1) & (size - 1);
+		gvn_table[slot] = gvn_scope[i];
+	}
+	free(old);
+}
+
+static void gvn_push(unsigned long hash, struct instruction *insn)
+{
+	unsigned int slot;
+
+	if (gvn_nr >= gvn_size / 2)
+		gvn_resize(gvn_size ? gvn_size * 2 : 256);
+	if (gvn_nr >= gvn_scope_size) {
+		gvn_scope_size = gvn_size;
+		gvn_scope = realloc(gvn_scope, gvn_scope_size * sizeof(*gvn_scope));
+		if (!gvn_scope)
+			die("out of memory");
+	}
+
+	slot = gvn_slot(hash, gvn_size);
+	while (gvn_table[slot].insn)
+		slot = (slot + 1) & (gvn_size - 1);
+	gvn_table[slot].hash = hash;
+	gvn_table[slot].insn = insn;
+	gvn_scope[gvn_nr].hash = hash;
+	gvn_scope[gvn_nr].insn = insn;
+	gvn_nr++;
+}
+
+//
+// Remove the most recently added entries, down to @nr.
+// With linear probing, removing the entries in the reverse
+// order of their insertion leaves the other chains intact.
+static void gvn_pop(unsigned int nr)
+{
+	while (gvn_nr > nr) {
+		struct gvn_entry *entry = &gvn_scope[--gvn_nr];
+		unsigned int slot = gvn_slot(entry->hash, gvn_size);
+
+		while (gvn_table[slot].insn != entry->insn)
+			slot = (slot + 1) & (gvn_size - 1);
+		gvn_table[slot].insn = NULL;
+	}
 }
 
 static struct basic_block *trivial_common_parent(struct basic_block *bb1, struct basic_block *bb2)
@@ -298,75 +380,98 @@ static inline void remove_instruction(struct instruction_list **list, struct ins
 	delete_ptr_list_entry((struct ptr_list **)list, insn, count);
 }
 
-static struct instruction * try_to_cse(struct entrypoint *ep, struct instruction *i1, struct instruction *i2)
+//
+// Try to replace @insn by the identical instruction @def.
+// @def is either in a block dominating @insn's one (which is
+// then on the current path in the dominance tree) or in a
+// sibling block with the same single parent, in which case
+// it's moved to this parent.
+static int try_to_cse(struct instruction *insn, struct instruction *def)
 {
-	struct basic_block *b1, *b2, *common;
-
-	/*
-	 * OK, i1 and i2 are the same instruction, modulo "target".
-	 * We should now see if we can combine them.
-	 */
-	b1 = i1->bb;
-	b2 = i2->bb;
-
-	/*
-	 * Currently we only handle the uninteresting degenerate case where
-	 * the CSE is inside one basic-block.
-	 */
-	if (b1 == b2) {
-		struct instruction *insn;
-		FOR_EACH_PTR(b1->insns, insn) {
-			if (insn == i1)
-				return cse_one_instruction(i2, i1);
-			if (insn == i2)
-				return cse_one_instruction(i1, i2);
-		} END_FOR_EACH_PTR(insn);
-		warning(b1->pos, "Whaa? unable to find CSE instructions");
-		return i1;
-	}
-	if (domtree_dominates(b1, b2))
-		return cse_one_instruction(i2, i1);
+	struct basic_block *b1 = def->bb;
+	struct basic_block *b2 = insn->bb;
+	struct basic_block *common;
 
-	if (domtree_dominates(b2, b1))
-		return cse_one_instruction(i1, i2);
+	if (b1->generation == gvn_generation) {
+		cse_one_instruction(insn, def);
+		return 1;
+	}
 
-	/* No direct dominance - but we could try to find a common ancestor.. */
 	common = trivial_common_parent(b1, b2);
-	if (common) {
-		i1 = cse_one_instruction(i2, i1);
-		remove_instruction(&b1->insns, i1, 1);
-		insert_last_instruction(common, i1);
-	} else {
-		i1 = i2;
+	if (!common)
+		return 0;
+	cse_one_instruction(insn, def);
+	remove_instruction(&b1->insns, def, 1);
+	insert_last_instruction(common, def);
+	queue_users(def->target);	// it moved to another block
+	return 1;
+}
+
+static int gvn_lookup(unsigned long hash, struct instruction *insn)
+{
+	unsigned int slot;
+
+	if (!gvn_nr)
+		return 0;
+	slot = gvn_slot(hash, gvn_size);
+	for (;; slot = (slot + 1) & (gvn_size - 1)) {
+		struct gvn_entry *entry = &gvn_table[slot];
+		struct instruction *def = entry->insn;
+
+		if (!def)
+			return 0;
+		if (entry->hash != hash || !def->bb)
+			continue;
+		// the operands of an entry may have changed since it was added
+		if (def->opcode != insn->opcode || insn_compare(def, insn))
+			continue;
+		if (try_to_cse(insn, def))
+			return 1;
 	}
+}
 
-	return i1;
+static void cse_bb(struct basic_block *bb, int keep)
+{
+	unsigned int nr = gvn_nr, own;
+	struct basic_block *child;
+	struct instruction *insn;
+
+	bb->generation = gvn_generation;
+
+	// Note: the dominance tree is only rebuilt after some CFG changes,
+	// so some of the blocks may be dead, but they still dominate
+	// the blocks below them.
+	FOR_EACH_PTR(bb->insns, insn) {
+		unsigned long hash;
+
+		if (!insn->bb)
+			continue;
+		if (!insn_hash(insn, &hash))
+			continue;
+		if (!gvn_lookup(hash, insn))
+			gvn_push(hash, insn);
+	} END_FOR_EACH_PTR(insn);
+	own = gvn_nr;
+
+	// First the children with this block as single parent, keeping
+	// their instructions: those present in two of them can be moved
+	// up into this block.
+	FOR_EACH_PTR(bb->doms, child) {
+		if (bb_list_size(child->parents) == 1)
+			cse_bb(child, 1);
+	} END_FOR_EACH_PTR(child);
+	gvn_pop(own);
+
+	FOR_EACH_PTR(bb->doms, child) {
+		if (bb_list_size(child->parents) != 1)
+			cse_bb(child, 0);
+	} END_FOR_EACH_PTR(child);
+	gvn_pop(keep ? own : nr);
+	bb->generation = 0;
 }
 
 void cse_eliminate(struct entrypoint *ep)
 {
-	int i;
-
-	for (i = 0; i < INSN_HASH_SIZE; i++) {
-		struct instruction_list **list = insn_hash_table + i;
-		if (*list) {
-			if (instruction_list_size(*list) > 1) {
-				struct instruction *insn, *last;
-
-				sort_instruction_list(list);
-
-				last = NULL;
-				FOR_EACH_PTR(*list, insn) {
-					if (!insn->bb)
-						continue;
-					if (last) {
-						if (!insn_compare(last, insn))
-							insn = try_to_cse(ep, last, insn);
-					}
-					last = insn;
-				} END_FOR_EACH_PTR(insn);
-			}
-			free_ptr_list(list);
-		}
-	}
+	gvn_generation = ++bb_generation;
+	cse_bb(ep->entry->bb, 0);
 }
@@ -271,6 +271,11 @@ static struct symbol *__lookup_member(struct symbol *type, struct ident *name, i
 	struct symbol *node;
 	int addr = 0;
 
+	if (name && !p_addr) {
+		int offset = 0;
+		return find_struct_member(type, name, &offset);
+	}
+
 	FOR_EACH_PTR(type->symbol_list, node)
 		if (!name) {
 			if (addr == *p_addr)
@@ -126,6 +126,47 @@ void idf_compute(struct entrypoint *ep, struct basic_block_list **idf, struct ba
 	bank_free(bank, levels);
 }
 
+///
+// compute the dominance frontier of all the blocks
+//
+// This uses the method described in:
+//	"A Simple, Fast Dominance Algorithm"
+//	by Keith D. Cooper, Timothy J. Harvey and Ken Kennedy
+// and needs an up-to-date dominance tree.
+struct basic_block_list **df_compute(struct entrypoint *ep, unsigned int size)
+{
+	struct basic_block_list **df = calloc(size, sizeof(*df));
+	struct basic_block *bb;
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct basic_block *idom = bb->idom;
+		struct basic_block *parent;
+
+		if (!ptr_list_multiple((struct ptr_list *)bb->parents))
+			continue;
+		FOR_EACH_PTR(bb->parents, parent) {
+			struct basic_block *runner;
+
+			for (runner = parent; runner && runner != idom; runner = runner->idom) {
+				struct basic_block_list **list = &df[runner->postorder_nr];
+
+				// already done via another parent?
+				if (last_ptr_list((struct ptr_list *)*list) == bb)
+					break;
+				add_bb(list, bb);
+			}
+		} END_FOR_EACH_PTR(parent);
+	} END_FOR_EACH_PTR(bb);
+	return df;
+}
+
+void df_free(struct basic_block_list **df, unsigned int size)
+{
+	while (size--)
+		free_ptr_list(&df[size]);
+	free(df);
+}
+
 void idf_dump(struct entrypoint *ep)
 {
 	struct basic_block *bb;
@@ -6,6 +6,10 @@ struct basic_block_list;
 
 void idf_compute(struct entrypoint *ep, struct basic_block_list **idf, struct basic_block_list *alpha);
 
+// The dominance frontiers, indexed by the blocks' postorder number.
+struct basic_block_list **df_compute(struct entrypoint *ep, unsigned int size);
+void df_free(struct basic_block_list **df, unsigned int size);
+
 
 // For debugging only
 void idf_dump(struct entrypoint *ep);
@@ -42,6 +42,7 @@
 #include "symbol.h"
 #include "target.h"
 #include "expression.h"
+#include "stats.h"
 
 struct symbol *current_fn;
 
@@ -61,16 +62,61 @@ static inline int valid_subexpr_type(struct expression *expr)
 	    && valid_expr_type(expr->right);
 }
 
+///
+// interning of the derived types
+//
+// The types derived from a symbol (the pointers to it, its copies with
+// other modifiers or address space) are created again and again while
+// evaluating the expressions. They're chained to the symbol, via its
+// 'derived' & their 'next_derived', so that equal types are shared,
+// which saves memory and makes type_difference() stop early, at the
+// pointer comparison.
+// Since the symbols are sometimes copied as a whole, a chain can also
+// hold the types derived from another symbol: the entries are always
+// checked against the symbol they're looked up for.
+static void add_derived(struct symbol *sym, struct symbol *derived)
+{
+	derived->next_derived = sym->derived;
+	sym->derived = derived;
+}
+
+#define FOR_EACH_DERIVED(sym, type)					\
+	for (type = (sym)->derived; type; type = type->next_derived)
+
+///
+// a copy of a node but with the given address space & modifiers
+static struct symbol *node_variant(struct symbol *sym, struct ident *as, unsigned long mod)
+{
+	struct symbol *variant;
+
+	FOR_EACH_DERIVED(sym, variant) {
+		if (variant->ctype.base_type != sym->ctype.base_type)
+			continue;
+		if (variant->ident != sym->ident || variant->bit_size != sym->bit_size)
+			continue;
+		if (variant->ctype.alignment != sym->ctype.alignment)
+			continue;
+		if (variant->ctype.as == as && variant->ctype.modifiers == mod)
+			return variant;
+	}
+
+	variant = alloc_symbol(sym->pos, SYM_NODE);
+	*variant = *sym;
+	variant->ctype.as = as;
+	variant->ctype.modifiers = mod;
+	variant->derived = NULL;
+	add_derived(sym, variant);
+	return variant;
+}
+
 static struct symbol *unqualify_type(struct symbol *ctype)
 {
 	if (!ctype)
 		return ctype;
 	if (ctype->type == SYM_NODE && (ctype->ctype.modifiers & MOD_QUALIFIER)) {
-		struct symbol *unqual = alloc_symbol(ctype->pos, 0);
+		unsigned long mod = ctype->ctype.modifiers & ~MOD_QUALIFIER;
 
-		*unqual = *ctype;
-		unqual->ctype.modifiers &= ~MOD_QUALIFIER;
-		return unqual;
+		return node_variant(ctype, ctype->ctype.as, mod);
 	}
 	return ctype;
 }
@@ -1647,27 +1693,16 @@ static struct symbol *convert_to_as_mod(struct symbol *sym, struct ident *as, in
 {
 	/* Take the modifiers of the pointer, and apply them to the member */
 	mod |= sym->ctype.modifiers;
-	if (sym->ctype.as != as || sym->ctype.modifiers != mod) {
-		struct symbol *newsym = alloc_symbol(sym->pos, SYM_NODE);
-		*newsym = *sym;
-		newsym->ctype.as = as;
-		newsym->ctype.modifiers = mod;
-		sym = newsym;
-	}
+	if (sym->ctype.as != as || sym->ctype.modifiers != mod)
+		sym = node_variant(sym, as, mod);
 	return sym;
 }
 
 static struct symbol *create_pointer(struct expression *expr, struct symbol *sym, int degenerate)
 {
-	struct symbol *node = alloc_symbol(expr->pos, SYM_NODE);
-	struct symbol *ptr = alloc_symbol(expr->pos, SYM_PTR);
-
-	node->ctype.base_type = ptr;
-	ptr->bit_size = bits_in_pointer;
-	ptr->ctype.alignment = pointer_alignment;
-
-	node->bit_size = bits_in_pointer;
-	node->ctype.alignment = pointer_alignment;
+	struct symbol *node, *ptr;
+	struct ident *as = NULL;
+	unsigned long mod = 0;
 
 	access_symbol(sym);
 	if (sym->ctype.modifiers & MOD_REGISTER) {
@@ -1675,17 +1710,38 @@ static struct symbol *create_pointer(struct expression *expr, struct symbol *sym
 		sym->ctype.modifiers &= ~MOD_REGISTER;
 	}
 	if (sym->type == SYM_NODE) {
-		combine_address_space(sym->pos, &ptr->ctype.as, sym->ctype.as);
-		ptr->ctype.modifiers |= sym->ctype.modifiers & MOD_PTRINHERIT;
+		combine_address_space(sym->pos, &as, sym->ctype.as);
+		mod |= sym->ctype.modifiers & MOD_PTRINHERIT;
 		sym = sym->ctype.base_type;
 	}
 	if (degenerate && sym->type == SYM_ARRAY) {
-		combine_address_space(sym->pos, &ptr->ctype.as, sym->ctype.as);
-		ptr->ctype.modifiers |= sym->ctype.modifiers & MOD_PTRINHERIT;
+		combine_address_space(sym->pos, &as, sym->ctype.as);
+		mod |= sym->ctype.modifiers & MOD_PTRINHERIT;
 		sym = sym->ctype.base_type;
 	}
-	ptr->ctype.base_type = sym;
 
+	FOR_EACH_DERIVED(sym, node) {
+		ptr = node->ctype.base_type;
+		if (ptr->type != SYM_PTR || ptr->ctype.base_type != sym)
+			continue;
+		if (ptr->ctype.as == as && ptr->ctype.modifiers == mod)
+			return node;
+	}
+
+	node = alloc_symbol(expr->pos, SYM_NODE);
+	ptr = alloc_symbol(expr->pos, SYM_PTR);
+
+	node->ctype.base_type = ptr;
+	ptr->bit_size = bits_in_pointer;
+	ptr->ctype.alignment = pointer_alignment;
+
+	node->bit_size = bits_in_pointer;
+	node->ctype.alignment = pointer_alignment;
+
+	ptr->ctype.as = as;
+	ptr->ctype.modifiers = mod;
+	ptr->ctype.base_type = sym;
+	add_derived(sym, node);
 	return node;
 }
 
@@ -1993,40 +2049,6 @@ static struct symbol *evaluate_preop(struct expression *expr)
 	return ctype;
 }
 
-static struct symbol *find_identifier(struct ident *ident, struct symbol_list *_list, int *offset)
-{
-	struct ptr_list *head = (struct ptr_list *)_list;
-	struct ptr_list *list = head;
-
-	if (!head)
-		return NULL;
-	do {
-		int i;
-		for (i = 0; i < list->nr; i++) {
-			struct symbol *sym = (struct symbol *) list->list[i];
-			if (sym->ident) {
-				if (sym->ident != ident)
-					continue;
-				*offset = sym->offset;
-				return sym;
-			} else {
-				struct symbol *ctype = sym->ctype.base_type;
-				struct symbol *sub;
-				if (!ctype)
-					continue;
-				if (ctype->type != SYM_UNION && ctype->type != SYM_STRUCT)
-					continue;
-				sub = find_identifier(ident, ctype->symbol_list, offset);
-				if (!sub)
-					continue;
-				*offset += sym->offset;
-				return sub;
-			}	
-		}
-	} while ((list = list->next) != head);
-	return NULL;
-}
-
 static struct expression *evaluate_offset(struct expression *expr, unsigned long offset)
 {
 	struct expression *add;
@@ -2092,7 +2114,7 @@ static struct symbol *evaluate_member_dereference(struct expression *expr)
 		return NULL;
 	}
 	offset = 0;
-	member = find_identifier(ident, ctype->symbol_list, &offset);
+	member = find_struct_member(ctype, ident, &offset);
 	if (!member) {
 		const char *type = ctype->type == SYM_STRUCT ? "struct" : "union";
 		const char *name = "<unnamed>";
@@ -2483,7 +2505,7 @@ static struct expression *check_designators(struct expression *e,
 				err = "field name not in struct or union";
 				break;
 			}
-			ctype = find_identifier(e->expr_ident, ctype->symbol_list, &offset);
+			ctype = find_struct_member(ctype, e->expr_ident, &offset);
 			if (!ctype) {
 				err = "unknown field name in";
 				break;
@@ -3234,7 +3256,7 @@ static struct symbol *evaluate_offsetof(struct expression *expr)
 			return NULL;
 		}
 
-		field = find_identifier(expr->ident, ctype->symbol_list, &offset);
+		field = find_struct_member(ctype, expr->ident, &offset);
 		if (!field) {
 			expression_error(expr, "unknown member");
 			return NULL;
@@ -3570,11 +3592,13 @@ void evaluate_symbol_list(struct symbol_list *list)
 {
 	struct symbol *sym;
 
+	phase_start(PHASE_EVALUATE);
 	FOR_EACH_PTR(list, sym) {
 		has_error &= ~ERROR_CURR_PHASE;
 		evaluate_symbol(sym);
 		check_duplicates(sym);
 	} END_FOR_EACH_PTR(sym);
+	phase_end(PHASE_EVALUATE);
 }
 
 static struct symbol *evaluate_return_expression(struct statement *stmt)
@@ -43,6 +43,7 @@
 #include "expression.h"
 #include "evaluate.h"
 #include "expand.h"
+#include "stats.h"
 
 
 static int expand_expression(struct expression *);
@@ -1201,12 +1202,14 @@ int expand_symbol(struct symbol *sym)
 	if (!base_type)
 		return 0;
 
+	phase_start(PHASE_EXPAND);
 	retval = expand_expression(sym->initializer);
 	/* expand the body of the symbol */
 	if (base_type->type == SYM_FN) {
 		if (base_type->stmt)
 			expand_statement(base_type->stmt);
 	}
+	phase_end(PHASE_EXPAND);
 	return retval;
 }
 
@@ -18,6 +18,8 @@
 #include "linearize.h"
 #include "simplify.h"
 #include "flow.h"
+#include "flowgraph.h"
+#include "liveness.h"
 #include "target.h"
 
 unsigned long bb_generation;
@@ -102,6 +104,8 @@ static int rewrite_branch(struct basic_block *bb,
 	replace_bb_in_list(&bb->children, old, new, 1);
 	remove_bb_from_list(&old->parents, bb, 1);
 	add_bb(&new->parents, bb);
+	domtree_bypass_bb(old);
+	domtree_remove_edge(bb, old);
 	return 1;
 }
 
@@ -128,20 +132,6 @@ static int pseudo_truth_value(pseudo_t pseudo)
 	}
 }
 
-/*
- * Does a basic block depend on the pseudos that "src" defines?
- */
-static int bb_depends_on(struct basic_block *target, struct basic_block *src)
-{
-	pseudo_t pseudo;
-
-	FOR_EACH_PTR(src->defines, pseudo) {
-		if (pseudo_in_list(target->needs, pseudo))
-			return 1;
-	} END_FOR_EACH_PTR(pseudo);
-	return 0;
-}
-
 /*
  * This really should be handled by bb_depends_on()
  * which efficiently check the dependence using the
@@ -158,7 +148,7 @@ static int bb_depends_on_phi(struct basic_block *target, struct basic_block *src
 			continue;
 		if (insn->opcode != OP_PHI)
 			continue;
-		if (pseudo_in_list(target->needs, insn->target))
+		if (pseudo_is_live_in(target, insn->target))
 			return 1;
 	} END_FOR_EACH_PTR(insn);
 	return 0;
@@ -399,6 +389,9 @@ void convert_instruction_target(struct instruction *insn, pseudo_t src)
 	target = insn->target;
 	if (target == src)
 		return;
+	queue_users(target);
+	if (has_definition(src))
+		queue_insn(src->def);	// it has new users
 	FOR_EACH_PTR(target->users, pu) {
 		if (*pu->userp != VOID) {
 			assert(*pu->userp == target);
@@ -501,7 +494,7 @@ static void kill_dead_stores_bb(pseudo_t pseudo, unsigned long generation, struc
 	if (bb->generation == generation)
 		return;
 	bb->generation = generation;
-	FOR_EACH_PTR_REVERSE(bb->insns, insn) {
+	FOR_EACH_PTR_REVERSE(memops_list(bb, pseudo, local), insn) {
 		if (!insn->bb)
 			continue;
 		switch (insn->opcode) {
@@ -635,6 +628,7 @@ void kill_bb(struct basic_block *bb)
 
 	FOR_EACH_PTR(bb->children, child) {
 		remove_bb_from_list(&child->parents, bb, 0);
+		domtree_remove_edge(bb, child);
 	} END_FOR_EACH_PTR(child);
 	bb->children = NULL;
 
@@ -642,6 +636,7 @@ void kill_bb(struct basic_block *bb)
 		remove_bb_from_list(&parent->children, bb, 0);
 	} END_FOR_EACH_PTR(parent);
 	bb->parents = NULL;
+	domtree_remove_bb(bb);
 }
 
 void kill_unreachable_bbs(struct entrypoint *ep)
@@ -820,6 +815,7 @@ int convert_to_jump(struct instruction *insn, struct basic_block *target)
 		}
 		DELETE_CURRENT_PTR(child);
 		remove_bb_from_list(&child->parents, bb, 1);
+		domtree_remove_edge(bb, child);
 		changed |= REPEAT_CFG_CLEANUP;
 	} END_FOR_EACH_PTR(child);
 	PACK_PTR_LIST(&bb->children);
@@ -929,6 +925,7 @@ static int merge_bb(struct basic_block *top, struct basic_block *bot)
 	} END_FOR_EACH_PTR(insn);
 	bot->insns = NULL;
 	bot->ep = NULL;
+	domtree_merge_bb(top, bot);
 	return REPEAT_CFG_CLEANUP;
 }
 
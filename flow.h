@@ -13,11 +13,15 @@ struct instruction;
 
 extern int remove_phisources(struct basic_block *par, struct basic_block *old);
 
+// queue the users of a pseudo for simplification (see optimize.c)
+extern void queue_users(pseudo_t pseudo);
+
 extern int simplify_flow(struct entrypoint *ep);
 
 extern void kill_dead_stores(struct entrypoint *ep, pseudo_t addr, int local);
 extern void simplify_symbol_usage(struct entrypoint *ep);
 extern void simplify_memops(struct entrypoint *ep);
+extern struct instruction_list *memops_list(struct basic_block *bb, pseudo_t addr, int local);
 extern void pack_basic_blocks(struct entrypoint *ep);
 extern int simplify_cfg_early(struct entrypoint *ep);
 extern int convert_to_jump(struct instruction *insn, struct basic_block *target);
@@ -8,6 +8,7 @@
 #include "flowgraph.h"
 #include "linearize.h"
 #include "flow.h"			// for bb_generation
+#include "stats.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -114,21 +115,12 @@ static void debug_domtree(struct entrypoint *ep)
 	} END_FOR_EACH_PTR(bb);
 }
 
-void domtree_build(struct entrypoint *ep)
+static struct basic_block **compute_idoms(struct entrypoint *ep, unsigned int size)
 {
 	struct basic_block *entry = ep->entry->bb;
 	struct basic_block **doms;
-	struct basic_block *bb;
-	unsigned int size;
-	int max_level = 0;
 	int changed;
 
-	// First calculate the (reverse) postorder.
-	// This will give use us:
-	//	- the links to do a reverse postorder traversal
-	//	- the order number for each block
-	size = cfg_postorder(ep);
-
 	// initialize the dominators array
 	doms = calloc(size, sizeof(*doms));
 	assert(entry->postorder_nr == size-1);
@@ -165,6 +157,44 @@ void domtree_build(struct entrypoint *ep)
 			}
 		} END_FOR_EACH_PTR(b);
 	} while (changed);
+	return doms;
+}
+
+static void domtree_number(struct basic_block *bb, unsigned int *nr)
+{
+	struct basic_block *child;
+
+	bb->dom_pre = (*nr)++;
+	FOR_EACH_PTR(bb->doms, child) {
+		domtree_number(child, nr);
+	} END_FOR_EACH_PTR(child);
+	bb->dom_post = (*nr)++;
+}
+
+static void domtree_renumber(struct entrypoint *ep)
+{
+	unsigned int nr = 0;
+
+	domtree_number(ep->entry->bb, &nr);
+	ep->dom_renumber = false;
+}
+
+void domtree_build(struct entrypoint *ep)
+{
+	struct basic_block *entry = ep->entry->bb;
+	struct basic_block **doms;
+	struct basic_block *bb;
+	unsigned int size;
+	int max_level = 0;
+
+	phase_start(PHASE_DOMTREE);
+
+	// First calculate the (reverse) postorder.
+	// This will give use us:
+	//	- the links to do a reverse postorder traversal
+	//	- the order number for each block
+	size = cfg_postorder(ep);
+	doms = compute_idoms(ep, size);
 
 	FOR_EACH_PTR(ep->bbs, bb) {
 		free_ptr_list(&bb->doms);
@@ -192,15 +222,19 @@ void domtree_build(struct entrypoint *ep)
 			max_level = level;
 	} END_FOR_EACH_PTR(bb);
 	ep->dom_levels = max_level + 1;
+	domtree_renumber(ep);
 
 	free(doms);
 	if (dbg_domtree)
 		debug_domtree(ep);
+	phase_end(PHASE_DOMTREE);
 }
 
 // dt_dominates - does BB a dominates BB b?
 bool domtree_dominates(struct basic_block *a, struct basic_block *b)
 {
+	struct entrypoint *ep = b->ep;
+
 	if (a == b)			// dominance is reflexive
 		return true;
 	if (a == b->idom)
@@ -208,16 +242,201 @@ bool domtree_dominates(struct basic_block *a, struct basic_block *b)
 	if (b == a->idom)
 		return false;
 
-	// can't dominate if deeper in the DT
-	if (a->dom_level >= b->dom_level)
-		return false;
-
-	// FIXME: can be faster if we have the DFS in-out numbers
+	if (ep) {
+		if (ep->dom_renumber)
+			domtree_renumber(ep);
+		return a->dom_pre < b->dom_pre && b->dom_post < a->dom_post;
+	}
 
-	// walk up the dominator tree
+	// a dead block: walk up the dominator tree
 	for (b = b->idom; b; b = b->idom) {
 		if (b == a)
 			return true;
 	}
 	return false;
 }
+
+///
+// incremental updates of the dominance tree
+// -----------------------------------------
+// The blocks dominated by @bb are handed to its own dominator.
+static void domtree_splice(struct basic_block *bb)
+{
+	struct basic_block *idom = bb->idom;
+	struct basic_block *child;
+
+	FOR_EACH_PTR(bb->doms, child) {
+		child->idom = idom;
+		add_bb(&idom->doms, child);
+	} END_FOR_EACH_PTR(child);
+	free_ptr_list(&bb->doms);
+}
+
+void domtree_remove_bb(struct basic_block *bb)
+{
+	struct basic_block *idom = bb->idom;
+
+	if (!idom)
+		return;
+	remove_bb_from_list(&idom->doms, bb, 1);
+	domtree_splice(bb);
+	bb->idom = NULL;
+	// the DFS numbers are still valid for the remaining blocks
+}
+
+void domtree_merge_bb(struct basic_block *top, struct basic_block *bot)
+{
+	struct basic_block *idom = bot->idom;
+	struct basic_block *child;
+
+	if (!idom)
+		return;
+	remove_bb_from_list(&idom->doms, bot, 1);
+	FOR_EACH_PTR(bot->doms, child) {
+		child->idom = top;
+		add_bb(&top->doms, child);
+	} END_FOR_EACH_PTR(child);
+	free_ptr_list(&bot->doms);
+	bot->idom = NULL;
+	if (idom != top)
+		top->ep->dom_renumber = true;
+}
+
+//
+// After a change of its parents, a block may be dominated by a block
+// deeper in the tree: the nearest common dominator of its parents.
+// The parents are only looked for near the block's current dominator.
+#define DOMTREE_WALK	64
+
+static void domtree_refine(struct basic_block *to)
+{
+	struct basic_block *chain[DOMTREE_WALK];
+	struct basic_block *idom = to->idom;
+	struct basic_block *parent, *bb, *new;
+	int len = 0, top = 0;
+
+	if (!idom || !to->ep)
+		return;
+
+	FOR_EACH_PTR(to->parents, parent) {
+		int n = 0, i = 0;
+
+		for (bb = parent; bb; bb = bb->idom) {
+			if (bb == to)		// a back edge: doesn't matter
+				break;
+			if (n++ == DOMTREE_WALK)
+				return;
+			if (!len) {
+				chain[n - 1] = bb;
+				if (bb == idom)
+					break;
+				continue;
+			}
+			for (i = 0; i < len; i++) {
+				if (chain[i] == bb)
+					break;
+			}
+			if (i < len)
+				break;
+			if (bb == idom)
+				return;
+		}
+		if (bb == to)
+			continue;
+		if (!len) {
+			len = n;
+			if (!bb && len > 1)	// not below the current dominator
+				len = 1;	// only the parent can be trusted
+			continue;
+		}
+		if (!bb)
+			return;
+		if (i > top)
+			top = i;
+	} END_FOR_EACH_PTR(parent);
+
+	if (!len)
+		return;
+	new = chain[top];
+	if (new == idom)
+		return;
+
+	remove_bb_from_list(&idom->doms, to, 1);
+	to->idom = new;
+	add_bb(&new->doms, to);
+	to->ep->dom_renumber = true;
+}
+
+void domtree_remove_edge(struct basic_block *from, struct basic_block *to)
+{
+	domtree_refine(to);
+}
+
+void domtree_bypass_bb(struct basic_block *bb)
+{
+	struct basic_block_list *doms = bb->doms;
+	struct basic_block *child;
+
+	if (!bb->idom || !doms)
+		return;
+	bb->doms = NULL;
+	FOR_EACH_PTR(doms, child) {
+		child->idom = bb->idom;
+		add_bb(&bb->idom->doms, child);
+	} END_FOR_EACH_PTR(child);
+	// most of them are still dominated by it but the refinement
+	// must only be done once all of them have been handed over.
+	FOR_EACH_PTR(doms, child) {
+		domtree_refine(child);
+	} END_FOR_EACH_PTR(child);
+	free_ptr_list(&doms);
+	bb->ep->dom_renumber = true;
+}
+
+void domtree_verify(struct entrypoint *ep)
+{
+	struct basic_block *entry = ep->entry->bb;
+	struct basic_block **doms;
+	struct basic_block *bb;
+	unsigned int size = 0;
+	int err = 0;
+
+	if (!dbg_ir || has_error)
+		return;
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		size++;
+	} END_FOR_EACH_PTR(bb);
+	doms = compute_idoms(ep, size);
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct basic_block *idom = bb->idom;
+		struct basic_block *dom;
+
+		if (bb == entry)
+			continue;
+		if (!idom || !idom->ep || !lookup_bb(idom->doms, bb)) {
+			sparse_error(bb->pos, "%s is not in the dominance tree", show_label(bb));
+			err++;
+			continue;
+		}
+		// the tree may be less precise than a rebuilt one but
+		// the dominator it gives must be a real one
+		for (dom = doms[bb->postorder_nr]; dom != idom; dom = doms[dom->postorder_nr]) {
+			if (dom == entry) {
+				sparse_error(bb->pos, "%s is not dominated by %s",
+					show_label(bb), show_label(idom));
+				err++;
+				break;
+			}
+		}
+		if (!domtree_dominates(idom, bb)) {
+			sparse_error(bb->pos, "bad DFS numbers for %s", show_label(bb));
+			err++;
+		}
+	} END_FOR_EACH_PTR(bb);
+
+	free(doms);
+	if (err)
+		abort();
+}
@@ -28,6 +28,39 @@ void domtree_build(struct entrypoint *ep);
 // @a: the basic block expected to dominate
 // @b: the basic block expected to be dominated
 // @return: ``true`` if @a dominates @b, ``false`` otherwise.
+//
+// This is done in constant time, using the DFS numbers of the tree.
 bool domtree_dominates(struct basic_block *a, struct basic_block *b);
 
+///
+// Update the dominance tree after a change to the CFG
+//
+// After these updates, the tree stays valid: the dominances it gives
+// hold but it may be less precise than a rebuilt one, since removing
+// some edges can add some dominances and only those close to the old
+// ones are tracked.
+// The levels (::dom_level) are only exact after domtree_build().
+
+///
+// @bb is removed from the CFG
+void domtree_remove_bb(struct basic_block *bb);
+
+///
+// @bot has been merged into its single parent @top
+void domtree_merge_bb(struct basic_block *top, struct basic_block *bot);
+
+///
+// the edge @from -> @to has been removed
+void domtree_remove_edge(struct basic_block *from, struct basic_block *to);
+
+///
+// some paths going through @bb now skip it
+// (to be called once the CFG has been updated)
+void domtree_bypass_bb(struct basic_block *bb);
+
+///
+// Check the dominance tree against a rebuilt one (only with -vir).
+// The postorder must be up to date.
+void domtree_verify(struct entrypoint *ep);
+
 #endif
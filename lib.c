@@ -47,6 +47,7 @@
 #include "target.h"
 #include "machine.h"
 #include "bits.h"
+#include "stats.h"
 
 static int prettify(const char **fnamep)
 {
@@ -144,6 +145,9 @@ static void do_warn(const char *type, struct position pos, const char * fmt, va_
 
 static int show_info = 1;
 
+// number of diagnostics issued so far, even if not shown
+unsigned int diag_count;
+
 void info(struct position pos, const char * fmt, ...)
 {
 	va_list args;
@@ -158,6 +162,7 @@ void info(struct position pos, const char * fmt, ...)
 static void do_error(struct position pos, const char * fmt, va_list args)
 {
 	static int errors = 0;
+	diag_count++;
         die_if_error = 1;
 	show_info = 1;
 	/* Shut up warnings if position is bad_token.pos */
@@ -189,6 +194,7 @@ void warning(struct position pos, const char * fmt, ...)
 		return;
 	}
 
+	diag_count++;
 	if (!fmax_warnings || has_error) {
 		show_info = 0;
 		return;
@@ -260,6 +266,8 @@ void add_pre_buffer(const char *fmt, ...)
 	va_start(args, fmt);
 	size = vsnprintf(buffer, sizeof(buffer), fmt, args);
 	va_end(args);
+	if (size >= sizeof(buffer))	// truncated
+		size = sizeof(buffer) - 1;
 	begin = tokenize_buffer(buffer, size, &end);
 	*pre_buffer_next = begin;
 	pre_buffer_next = &end->next;
@@ -299,7 +307,9 @@ static struct symbol_list *sparse_tokenstream(struct token *token)
 	int builtin = token && !token->pos.stream;
 
 	// Preprocess the stream
+	phase_start(PHASE_PREPROCESS);
 	token = preprocess(token);
+	phase_end(PHASE_PREPROCESS);
 
 	if (dump_macro_defs || dump_macros_only) {
 		if (!builtin)
@@ -330,8 +340,10 @@ static struct symbol_list *sparse_tokenstream(struct token *token)
 	}
 
 	// Parse the resulting C code
+	phase_start(PHASE_PARSE);
 	while (!eof_token(token))
 		token = external_declaration(token, &translation_unit_used_list, NULL);
+	phase_end(PHASE_PARSE);
 	return translation_unit_used_list;
 }
 
@@ -377,6 +389,132 @@ static struct symbol_list *sparse_initial(void)
 	return sparse_tokenstream(pre_buffer_begin);
 }
 
+static void start_output(struct string_list **filelist)
+{
+	// the included files' tokens can be reused if several files are given
+	if (filelist)
+		token_cache = ptr_list_multiple((struct ptr_list *)*filelist);
+
+	// Redirect stdout if needed
+	if (dump_macro_defs || preprocess_only)
+		do_output = 1;
+	if (do_output && outfile && strcmp(outfile, "-")) {
+		if (!freopen(outfile, "w", stdout))
+			die("error: cannot open %s: %s", outfile, strerror(errno));
+	}
+}
+
+/*
+ * With '--server', the initialization is done once, with the server's
+ * own options, and each request is then checked in a copy of this
+ * initialized state (see server.c).
+ *
+ * The options which only add something to the pre-buffer (macros,
+ * include paths and included files) or which are ignored can change
+ * with each request. All the other options change the initialized
+ * state and so must be the same for the server and the requests.
+ * They're kept here, grouped with their separated arguments, if any.
+ */
+struct server_option {
+	char **args;
+	int nr;
+};
+
+static struct server_option *server_options;
+static int server_options_nr;
+
+// where the pre-buffer entries of the requests must be inserted
+static struct token **request_pre_buffer;
+
+static int request_option(const char *arg)
+{
+	static const char *const options[] = {
+		"D", "U", "I", "include", "imacros", "isystem", "idirafter",
+		"nostdinc", "o", "M", "Wp,", "-server=", NULL
+	};
+	const char *const *opt;
+
+	for (opt = options; *opt; opt++) {
+		if (!strncmp(arg, *opt, strlen(*opt)))
+			return 1;
+	}
+	return 0;
+}
+
+static void add_server_option(char **args, int nr)
+{
+	server_options = realloc(server_options, (server_options_nr + 1) * sizeof(*server_options));
+	if (!server_options)
+		die("out of memory");
+	server_options[server_options_nr].args = args;
+	server_options[server_options_nr].nr = nr;
+	server_options_nr++;
+}
+
+static int match_server_option(char **args, int i)
+{
+	const struct server_option *opt;
+	int n;
+
+	if (i >= server_options_nr)
+		return 0;
+	opt = &server_options[i];
+	for (n = 0; n < opt->nr; n++) {
+		if (!args[n] || strcmp(args[n], opt->args[n]))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Handle the arguments of a request in the server's initialized state.
+ * Return -1 if the request needs another initialization than the
+ * server's one, otherwise the initial symbol list, like sparse_initialize().
+ */
+int sparse_request(char **argv, struct string_list **filelist, struct symbol_list **list)
+{
+	struct token *builtin = *request_pre_buffer;
+	struct token **end = pre_buffer_next;
+	char **args;
+	int i = 0;
+
+	// insert the request's pre-buffer before the builtin one
+	pre_buffer_next = request_pre_buffer;
+
+	args = argv;
+	for (;;) {
+		char *arg = *++args;
+		if (!arg)
+			break;
+
+		if (arg[0] == '-' && arg[1]) {
+			if (request_option(arg+1)) {
+				args = handle_switch(arg+1, args);
+				continue;
+			}
+			if (!match_server_option(args, i))
+				return -1;
+			args += server_options[i++].nr - 1;
+			continue;
+		}
+		add_ptr_list(filelist, arg);
+	}
+	if (i != server_options_nr)
+		return -1;
+
+	if (end != request_pre_buffer) {
+		*pre_buffer_next = builtin;
+		pre_buffer_next = end;
+	}
+
+	start_output(filelist);
+
+	*list = sparse_initial();
+	protect_token_alloc();
+	evaluate_symbol_list(*list);
+	return 0;
+}
+
 struct symbol_list *sparse_initialize(int argc, char **argv, struct string_list **filelist)
 {
 	char **args;
@@ -393,30 +531,32 @@ struct symbol_list *sparse_initialize(int argc, char **argv, struct string_list
 	args = argv;
 	for (;;) {
 		char *arg = *++args;
+		char **next;
 		if (!arg)
 			break;
 
 		if (arg[0] == '-' && arg[1]) {
-			args = handle_switch(arg+1, args);
+			next = handle_switch(arg+1, args);
+			if (server_path && !request_option(arg+1))
+				add_server_option(args, next - args + 1);
+			args = next;
 			continue;
 		}
 		add_ptr_list(filelist, arg);
 	}
 	handle_switch_finalize();
+	request_pre_buffer = pre_buffer_next;
 
-	// Redirect stdout if needed
-	if (dump_macro_defs || preprocess_only)
-		do_output = 1;
-	if (do_output && outfile && strcmp(outfile, "-")) {
-		if (!freopen(outfile, "w", stdout))
-			die("error: cannot open %s: %s", outfile, strerror(errno));
-	}
+	if (server_path && filelist && *filelist)
+		die("no files can be given to the server");
+
+	start_output(filelist);
 
 	if (fdump_ir == 0)
 		fdump_ir = PASS_FINAL;
 
 	list = NULL;
-	if (filelist) {
+	if (filelist || server_path) {
 		// Initialize type system
 		target_init();
 		init_ctype();
@@ -425,6 +565,10 @@ struct symbol_list *sparse_initialize(int argc, char **argv, struct string_list
 		create_builtin_stream();
 		init_builtins(0);
 
+		// the rest is done for each request, see sparse_request()
+		if (server_path)
+			return NULL;
+
 		list = sparse_initial();
 
 		/*
@@ -76,10 +76,10 @@ DECLARE_PTR_LIST(symbol_list, struct symbol);
 DECLARE_PTR_LIST(statement_list, struct statement);
 DECLARE_PTR_LIST(asm_operand_list, struct asm_operand);
 DECLARE_PTR_LIST(expression_list, struct expression);
-DECLARE_PTR_LIST(basic_block_list, struct basic_block);
-DECLARE_PTR_LIST(instruction_list, struct instruction);
-DECLARE_PTR_LIST(multijmp_list, struct multijmp);
-DECLARE_PTR_LIST(pseudo_list, struct pseudo);
+DECLARE_IR_PTR_VECTOR(basic_block_list, struct basic_block);
+DECLARE_IR_PTR_VECTOR(instruction_list, struct instruction);
+DECLARE_IR_PTR_LIST(multijmp_list, struct multijmp);
+DECLARE_IR_PTR_LIST(pseudo_list, struct pseudo);
 DECLARE_PTR_LIST(ident_list, struct ident);
 DECLARE_PTR_LIST(string_list, char);
 
@@ -109,12 +109,14 @@ extern void expression_error(struct expression *, const char *, ...) FORMAT_ATTR
 #define	ERROR_CURR_PHASE	(1 << 0)
 #define	ERROR_PREV_PHASE	(1 << 1)
 extern int has_error;
+extern unsigned int diag_count;
 
 
 enum phase {
 	PASS__PARSE,
 	PASS__LINEARIZE,
 	PASS__MEM2REG,
+	PASS__SCCP,
 	PASS__OPTIM,
 	PASS__FINAL,
 };
@@ -122,6 +124,7 @@ enum phase {
 #define	PASS_PARSE		(1UL << PASS__PARSE)
 #define	PASS_LINEARIZE		(1UL << PASS__LINEARIZE)
 #define	PASS_MEM2REG		(1UL << PASS__MEM2REG)
+#define	PASS_SCCP		(1UL << PASS__SCCP)
 #define	PASS_OPTIM		(1UL << PASS__OPTIM)
 #define	PASS_FINAL		(1UL << PASS__FINAL)
 
@@ -136,6 +139,9 @@ extern void predefined_macros(void);
 
 extern void dump_macro_definitions(void);
 extern struct symbol_list *sparse_initialize(int argc, char **argv, struct string_list **files);
+extern int sparse_request(char **argv, struct string_list **files, struct symbol_list **list);
+extern struct symbol_list *sparse_server(const char *path, struct string_list **files);
+extern int sparse_client(int argc, char **argv);
 extern struct symbol_list *__sparse(char *filename);
 extern struct symbol_list *sparse_keep_tokens(char *filename);
 extern struct symbol_list *sparse(char *filename);
@@ -22,6 +22,7 @@
 #include "optimize.h"
 #include "flow.h"
 #include "target.h"
+#include "stats.h"
 
 static pseudo_t linearize_statement(struct entrypoint *ep, struct statement *stmt);
 static pseudo_t linearize_expression(struct entrypoint *ep, struct expression *expr);
@@ -379,7 +380,7 @@ const char *show_instruction(struct instruction *insn)
 	}
 	case OP_SETFVAL:
 		buf += sprintf(buf, "%s <- ", show_pseudo(insn->target));
-		buf += sprintf(buf, "%Le", insn->fvalue);
+		buf += sprintf(buf, "%Le", *insn->fvalue);
 		break;
 
 	case OP_SWITCH: {
@@ -785,10 +786,12 @@ static pseudo_t symbol_pseudo(struct entrypoint *ep, struct symbol *sym)
 	return pseudo;
 }
 
+#define MAX_VAL_HASH 64
+static struct pseudo_list *value_pseudos[MAX_VAL_HASH];
+
 pseudo_t value_pseudo(long long val)
 {
-#define MAX_VAL_HASH 64
-	static struct pseudo_list *prev[MAX_VAL_HASH];
+	struct pseudo_list **prev = value_pseudos;
 	int hash = val & (MAX_VAL_HASH-1);
 	struct pseudo_list **list = prev + hash;
 	pseudo_t pseudo;
@@ -1082,12 +1085,15 @@ static pseudo_t add_setval(struct entrypoint *ep, struct symbol *ctype, struct e
 	return target;
 }
 
+__ALLOCATOR(long double, "fvalues", fvalue);
+
 static pseudo_t add_setfval(struct entrypoint *ep, struct symbol *ctype, long double fval)
 {
 	struct instruction *insn = alloc_typed_instruction(OP_SETFVAL, ctype);
 	pseudo_t target = alloc_pseudo(insn);
 	insn->target = target;
-	insn->fvalue = fval;
+	insn->fvalue = __alloc_fvalue(0);
+	*insn->fvalue = fval;
 	add_one_insn(ep, insn);
 	return target;
 }
@@ -2589,11 +2595,71 @@ struct entrypoint *linearize_symbol(struct symbol *sym)
 	base_type = sym->ctype.base_type;
 	if (!base_type)
 		return NULL;
-	if (base_type->type == SYM_FN)
-		return linearize_fn(sym, base_type);
+	if (base_type->type == SYM_FN) {
+		struct entrypoint *ep;
+
+		phase_start(PHASE_LINEARIZE);
+		ep = linearize_fn(sym, base_type);
+		phase_end_function(PHASE_LINEARIZE, sym);
+		return ep;
+	}
 	return NULL;
 }
 
+///
+// IR arenas
+//
+// The IR of a function is generally not needed anymore once the
+// function has been checked. The allocations made between
+// mark_ir_allocations() and release_ir_allocations() are released
+// together. Tools needing the IR of all the functions at once simply
+// don't use them.
+//
+// Only the IR objects themselves and the lists & maps declared with
+// DECLARE_IR_PTR_LIST(), DECLARE_IR_PTR_VECTOR() or DECLARE_IR_PTRMAP()
+// are released: none of them may be kept past the function, while any
+// other list or map can be created meanwhile and outlive the IR.
+void mark_ir_allocations(void)
+{
+	mark_entrypoint_alloc();
+	mark_basic_block_alloc();
+	mark_instruction_alloc();
+	mark_multijmp_alloc();
+	mark_pseudo_alloc();
+	mark_pseudo_user_alloc();
+	mark_asm_rules_alloc();
+	mark_asm_constraint_alloc();
+	mark_fvalue_alloc();
+	mark_ir_ptrlists();
+	mark_ir_ptrmaps();
+}
+
+void release_ir_allocations(struct entrypoint *ep)
+{
+	pseudo_t pseudo;
+
+	// drop the references from the symbols to the IR
+	if (ep) {
+		FOR_EACH_PTR(ep->accesses, pseudo) {
+			pseudo->sym->pseudo = NULL;
+		} END_FOR_EACH_PTR(pseudo);
+		ep->name->ep = NULL;
+	}
+	memset(value_pseudos, 0, sizeof(value_pseudos));
+
+	release_entrypoint_alloc();
+	release_basic_block_alloc();
+	release_instruction_alloc();
+	release_multijmp_alloc();
+	release_pseudo_alloc();
+	release_pseudo_user_alloc();
+	release_asm_rules_alloc();
+	release_asm_constraint_alloc();
+	release_fvalue_alloc();
+	release_ir_ptrlists();
+	release_ir_ptrmaps();
+}
+
 /*
  * Builtin functions
  */
@@ -17,8 +17,8 @@ struct pseudo_user {
 };
 
 DECLARE_ALLOCATOR(pseudo_user);
-DECLARE_PTR_LIST(pseudo_user_list, struct pseudo_user);
-DECLARE_PTRMAP(phi_map, struct symbol *, struct instruction *);
+DECLARE_IR_PTR_VECTOR(pseudo_user_list, struct pseudo_user);
+DECLARE_IR_PTRMAP(phi_map, struct symbol *, struct instruction *);
 
 
 enum pseudo_type {
@@ -77,7 +77,7 @@ struct asm_constraint {
 };
 
 DECLARE_ALLOCATOR(asm_constraint);
-DECLARE_PTR_LIST(asm_constraint_list, struct asm_constraint);
+DECLARE_IR_PTR_LIST(asm_constraint_list, struct asm_constraint);
 
 struct asm_rules {
 	struct asm_constraint_list *inputs;
@@ -86,11 +86,13 @@ struct asm_rules {
 };
 
 DECLARE_ALLOCATOR(asm_rules);
+__DECLARE_ALLOCATOR(long double, fvalue);
 
 struct instruction {
 	unsigned opcode:7,
 		 tainted:1,
 		 size:24;
+	unsigned queued:1;		// on the simplification or SCCP worklist
 	struct basic_block *bb;
 	struct position pos;
 	struct symbol *type;
@@ -137,7 +139,9 @@ struct instruction {
 			struct expression *val;
 		};
 		struct /* setfval */ {
-			long double fvalue;
+			// kept aside: a long double would double the
+			// alignment and the size of all instructions
+			long double *fvalue;
 		};
 		struct /* call */ {
 			pseudo_t func;
@@ -171,10 +175,10 @@ struct basic_block {
 	struct basic_block *idom;	/* link to the immediate dominator */
 	unsigned int nr;		/* unique id for label's names */
 	int dom_level;			/* level in the dominance tree */
+	unsigned int dom_pre, dom_post;	/* DFS numbers in the dominance tree */
 	struct basic_block_list *doms;	/* list of BB idominated by this one */
 	struct pseudo_list *needs, *defines;
 	union {
-		struct phi_map *phi_map;/* needed during SSA conversion */
 		int postorder_nr;	/* postorder number */
 		int context;		/* needed during context checking */
 		void *priv;
@@ -297,11 +301,15 @@ static inline struct pseudo_user *alloc_pseudo_user(struct instruction *insn, ps
 	return user;
 }
 
+// the worklist of the instructions to simplify (see optimize.c)
+extern void queue_insn(struct instruction *insn);
+
 static inline void use_pseudo(struct instruction *insn, pseudo_t p, pseudo_t *pp)
 {
 	*pp = p;
 	if (has_use_list(p))
 		add_pseudo_user_ptr(alloc_pseudo_user(insn, pp), &p->users);
+	queue_insn(insn);
 }
 
 static inline void link_phi(struct instruction *node, pseudo_t phi)
@@ -329,6 +337,7 @@ struct entrypoint {
 	struct basic_block *active;
 	struct instruction *entry;
 	unsigned int dom_levels;	/* max levels in the dom tree */
+	bool dom_renumber;		/* the DFS numbers need an update */
 };
 
 extern void insert_select(struct basic_block *bb, struct instruction *br, struct instruction *phi, pseudo_t if_true, pseudo_t if_false);
@@ -344,6 +353,8 @@ pseudo_t value_pseudo(long long val);
 pseudo_t undef_pseudo(void);
 
 struct entrypoint *linearize_symbol(struct symbol *sym);
+void mark_ir_allocations(void);
+void release_ir_allocations(struct entrypoint *ep);
 int unssa(struct entrypoint *ep);
 void show_entry(struct entrypoint *ep);
 void show_insn_entry(struct instruction *insn);
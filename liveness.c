@@ -6,12 +6,17 @@
  */
 
 #include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "liveness.h"
 #include "parse.h"
 #include "expression.h"
 #include "linearize.h"
 #include "flow.h"
+#include "flowgraph.h"
+#include "bitmap.h"
 
 static void phi_defines(struct instruction * phi_node, pseudo_t target,
 	void (*defines)(struct basic_block *, pseudo_t))
@@ -41,7 +46,7 @@ static void asm_liveness(struct basic_block *bb, struct instruction *insn,
 	FOR_EACH_PTR(insn->asm_rules->outputs, entry) {
 		if (entry->is_memory)
 			use(bb, entry->pseudo);
-		else
+		else if (def)
 			def(bb, entry->pseudo);
 	} END_FOR_EACH_PTR(entry);
 }
@@ -53,7 +58,7 @@ static void track_instruction_usage(struct basic_block *bb, struct instruction *
 	pseudo_t pseudo;
 
 	#define USES(x)		use(bb, insn->x)
-	#define DEFINES(x)	def(bb, insn->x)
+	#define DEFINES(x)	do { if (def) def(bb, insn->x); } while (0)
 
 	switch (insn->opcode) {
 	case OP_RET:
@@ -102,7 +107,8 @@ static void track_instruction_usage(struct basic_block *bb, struct instruction *
 	/* Other */
 	case OP_PHI:
 		/* Phi-nodes are "backwards" nodes. Their def doesn't matter */
-		phi_defines(insn, insn->target, def);
+		if (def)
+			phi_defines(insn, insn->target, def);
 		break;
 
 	case OP_PHISOURCE:
@@ -138,14 +144,10 @@ static void track_instruction_usage(struct basic_block *bb, struct instruction *
 }
 
 
-static int liveness_changed;
-
 static void add_pseudo_exclusive(struct pseudo_list **list, pseudo_t pseudo)
 {
-	if (!pseudo_in_list(*list, pseudo)) {
-		liveness_changed = 1;
+	if (!pseudo_in_list(*list, pseudo))
 		add_pseudo(list, pseudo);
-	}
 }
 
 static inline int trackable_pseudo(pseudo_t pseudo)
@@ -153,33 +155,160 @@ static inline int trackable_pseudo(pseudo_t pseudo)
 	return pseudo && (pseudo->type == PSEUDO_REG || pseudo->type == PSEUDO_ARG);
 }
 
-static void insn_uses(struct basic_block *bb, pseudo_t pseudo)
+static inline int is_global_use(struct basic_block *bb, pseudo_t pseudo)
+{
+	struct instruction *def;
+
+	if (!trackable_pseudo(pseudo))
+		return 0;
+	def = pseudo->def;
+	return pseudo->type != PSEUDO_REG || def->bb != bb || def->opcode == OP_PHI;
+}
+
+/*
+ * The liveness is calculated with bitsets, one bit per pseudo
+ * used in another block than the one defining it (the other
+ * pseudos are never live across blocks). These pseudos are
+ * given a dense index, found via their ->nr, and the blocks
+ * are identified by their postorder number.
+ */
+static struct {
+	int min_reg, max_reg;		// range of the REG pseudos' ->nr
+	int max_arg;
+	int *reg_index, *arg_index;	// index of the pseudos, or -1
+	pseudo_t *pseudos;		// the pseudos, by index
+	unsigned int nr_pseudos;
+	unsigned int nr_bbs;
+	unsigned long *sets;		// per BB: needs, defines & uses
+} live;
+
+static int *pseudo_index_slot(pseudo_t pseudo)
+{
+	if (pseudo->type == PSEUDO_ARG)
+		return &live.arg_index[pseudo->nr];
+	return &live.reg_index[pseudo->nr - live.min_reg];
+}
+
+static int pseudo_index(pseudo_t pseudo)
+{
+	if (!trackable_pseudo(pseudo) || !live.sets)
+		return -1;
+	if (pseudo->type == PSEUDO_ARG) {
+		if (pseudo->nr < 0 || pseudo->nr > live.max_arg)
+			return -1;
+	} else {
+		if (pseudo->nr < live.min_reg || pseudo->nr > live.max_reg)
+			return -1;
+	}
+	return *pseudo_index_slot(pseudo);
+}
+
+static unsigned long *bb_set(struct basic_block *bb, int which)
+{
+	unsigned int words = BITS_TO_LONGS(live.nr_pseudos);
+
+	return live.sets + (bb->postorder_nr * 3 + which) * words;
+}
+
+#define bb_needs(bb)	bb_set(bb, 0)
+#define bb_defines(bb)	bb_set(bb, 1)
+#define bb_uses(bb)	bb_set(bb, 2)
+
+// first pass: the range of the pseudos' numbers
+static void range_pseudo(struct basic_block *bb, pseudo_t pseudo)
 {
-	if (trackable_pseudo(pseudo)) {
-		struct instruction *def = pseudo->def;
-		if (pseudo->type != PSEUDO_REG || def->bb != bb || def->opcode == OP_PHI)
-			add_pseudo_exclusive(&bb->needs, pseudo);
+	if (!trackable_pseudo(pseudo))
+		return;
+	if (pseudo->type == PSEUDO_ARG) {
+		if (live.max_arg < pseudo->nr)
+			live.max_arg = pseudo->nr;
+		return;
 	}
+	if (live.min_reg > pseudo->nr)
+		live.min_reg = pseudo->nr;
+	if (live.max_reg < pseudo->nr)
+		live.max_reg = pseudo->nr;
+}
+
+// second pass: give an index to the pseudos live across blocks
+static void index_use(struct basic_block *bb, pseudo_t pseudo)
+{
+	int *slot;
+
+	if (!is_global_use(bb, pseudo))
+		return;
+	slot = pseudo_index_slot(pseudo);
+	if (*slot >= 0)
+		return;
+	*slot = live.nr_pseudos++;
+	live.pseudos[*slot] = pseudo;
+}
+
+// third pass: the local uses & definitions
+static void insn_uses(struct basic_block *bb, pseudo_t pseudo)
+{
+	if (is_global_use(bb, pseudo))
+		set_bit(*pseudo_index_slot(pseudo), bb_uses(bb));
 }
 
 static void insn_defines(struct basic_block *bb, pseudo_t pseudo)
 {
+	int idx;
+
 	assert(trackable_pseudo(pseudo));
-	add_pseudo(&bb->defines, pseudo);
+	idx = *pseudo_index_slot(pseudo);
+	if (idx >= 0)
+		set_bit(idx, bb_defines(bb));
+}
+
+// 'def' can be NULL if only the uses matter
+static void scan_usage(struct entrypoint *ep,
+	void (*def)(struct basic_block *, pseudo_t),
+	void (*use)(struct basic_block *, pseudo_t))
+{
+	struct basic_block *bb;
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *insn;
+		FOR_EACH_PTR(bb->insns, insn) {
+			if (!insn->bb)
+				continue;
+			assert(insn->bb == bb);
+			track_instruction_usage(bb, insn, def, use);
+		} END_FOR_EACH_PTR(insn);
+	} END_FOR_EACH_PTR(bb);
 }
 
-static void track_bb_liveness(struct basic_block *bb)
+static void *grow_array(void *array, size_t size)
 {
-	pseudo_t needs;
-
-	FOR_EACH_PTR(bb->needs, needs) {
-		struct basic_block *parent;
-		FOR_EACH_PTR(bb->parents, parent) {
-			if (!pseudo_in_list(parent->defines, needs)) {
-				add_pseudo_exclusive(&parent->needs, needs);
-			}
-		} END_FOR_EACH_PTR(parent);
-	} END_FOR_EACH_PTR(needs);
+	array = realloc(array, size);
+	if (!array && size)
+		die("out of memory");
+	return array;
+}
+
+static void index_pseudos(struct entrypoint *ep)
+{
+	unsigned int nr_regs, nr_args;
+
+	live.min_reg = INT_MAX;
+	live.max_reg = -1;
+	live.max_arg = 0;
+	scan_usage(ep, range_pseudo, range_pseudo);
+	if (live.max_reg < live.min_reg)
+		live.min_reg = live.max_reg + 1;
+
+	nr_regs = live.max_reg - live.min_reg + 1;
+	nr_args = live.max_arg + 1;
+	live.reg_index = grow_array(live.reg_index, nr_regs * sizeof(int));
+	live.arg_index = grow_array(live.arg_index, nr_args * sizeof(int));
+	live.pseudos = grow_array(live.pseudos, (nr_regs + nr_args) * sizeof(pseudo_t));
+	if (nr_regs)
+		memset(live.reg_index, -1, nr_regs * sizeof(int));
+	memset(live.arg_index, -1, nr_args * sizeof(int));
+
+	live.nr_pseudos = 0;
+	scan_usage(ep, NULL, index_use);
 }
 
 /*
@@ -194,6 +323,16 @@ void clear_liveness(struct entrypoint *ep)
 		free_ptr_list(&bb->needs);
 		free_ptr_list(&bb->defines);
 	} END_FOR_EACH_PTR(bb);
+	free(live.sets);
+	live.sets = NULL;
+}
+
+static void bitset_to_list(struct pseudo_list **list, unsigned long *set)
+{
+	unsigned int idx;
+
+	for_each_set_bit(idx, set, live.nr_pseudos)
+		add_pseudo(list, live.pseudos[idx]);
 }
 
 /*
@@ -202,44 +341,81 @@ void clear_liveness(struct entrypoint *ep)
  */
 void track_pseudo_liveness(struct entrypoint *ep)
 {
+	unsigned int nbits, words;
+	unsigned long *out;
 	struct basic_block *bb;
+	int changed;
+
+	live.nr_bbs = cfg_postorder(ep);
+	index_pseudos(ep);
 
 	/* Add all the bb pseudo usage */
+	nbits = live.nr_pseudos;
+	words = BITS_TO_LONGS(nbits);
+	free(live.sets);
+	// one more set for the temporary live-out
+	live.sets = calloc((live.nr_bbs * 3 + 1) * words + 1, sizeof(unsigned long));
+	if (!live.sets)
+		die("out of memory");
+	out = live.sets + live.nr_bbs * 3 * words;
+	scan_usage(ep, insn_defines, insn_uses);
+
+	/* Calculate liveness, in postorder since it flows backward */
 	FOR_EACH_PTR(ep->bbs, bb) {
-		struct instruction *insn;
-		FOR_EACH_PTR(bb->insns, insn) {
-			if (!insn->bb)
-				continue;
-			assert(insn->bb == bb);
-			track_instruction_usage(bb, insn, insn_defines, insn_uses);
-		} END_FOR_EACH_PTR(insn);
+		bitmap_copy(bb_needs(bb), bb_uses(bb), nbits);
 	} END_FOR_EACH_PTR(bb);
-
-	/* Calculate liveness.. */
 	do {
-		liveness_changed = 0;
+		changed = 0;
 		FOR_EACH_PTR_REVERSE(ep->bbs, bb) {
-			track_bb_liveness(bb);
-		} END_FOR_EACH_PTR_REVERSE(bb);
-	} while (liveness_changed);
-
-	/* Remove the pseudos from the "defines" list that are used internally */
-	FOR_EACH_PTR(ep->bbs, bb) {
-		pseudo_t def;
-		FOR_EACH_PTR(bb->defines, def) {
 			struct basic_block *child;
+
+			bitmap_zero(out, nbits);
 			FOR_EACH_PTR(bb->children, child) {
-				if (pseudo_in_list(child->needs, def))
-					goto is_used;
+				bitmap_or(out, out, bb_needs(child), nbits);
 			} END_FOR_EACH_PTR(child);
-			DELETE_CURRENT_PTR(def);
-is_used:
-		;
-		} END_FOR_EACH_PTR(def);
-		PACK_PTR_LIST(&bb->defines);
+			bitmap_andnot(out, out, bb_defines(bb), nbits);
+			bitmap_or(out, out, bb_uses(bb), nbits);
+			if (bitmap_equal(out, bb_needs(bb), nbits))
+				continue;
+			bitmap_copy(bb_needs(bb), out, nbits);
+			changed = 1;
+		} END_FOR_EACH_PTR_REVERSE(bb);
+	} while (changed);
+
+	/*
+	 * Build the lists, removing from the "defines" the pseudos
+	 * that are only used internally.
+	 */
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct basic_block *child;
+
+		bitmap_zero(out, nbits);
+		FOR_EACH_PTR(bb->children, child) {
+			bitmap_or(out, out, bb_needs(child), nbits);
+		} END_FOR_EACH_PTR(child);
+		bitmap_and(bb_defines(bb), bb_defines(bb), out, nbits);
+
+		bitset_to_list(&bb->needs, bb_needs(bb));
+		bitset_to_list(&bb->defines, bb_defines(bb));
 	} END_FOR_EACH_PTR(bb);
 }
 
+int pseudo_is_live_in(struct basic_block *bb, pseudo_t pseudo)
+{
+	int idx = pseudo_index(pseudo);
+
+	if (idx < 0 || !bb->ep)
+		return 0;
+	return test_bit(idx, bb_needs(bb));
+}
+
+int bb_depends_on(struct basic_block *target, struct basic_block *src)
+{
+	if (!live.sets)
+		return 0;
+	return bitmap_intersects(bb_defines(src), bb_needs(target), live.nr_pseudos);
+}
+
 static void merge_pseudo_list(struct pseudo_list *src, struct pseudo_list **dest)
 {
 	pseudo_t pseudo;
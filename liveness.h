@@ -2,10 +2,16 @@
 #define LIVENESS_H
 
 struct entrypoint;
+struct basic_block;
+struct pseudo;
 
 /* liveness.c */
 void clear_liveness(struct entrypoint *ep);
 void track_pseudo_liveness(struct entrypoint *ep);
 void track_pseudo_death(struct entrypoint *ep);
 
+/* valid after track_pseudo_liveness() until clear_liveness() */
+int pseudo_is_live_in(struct basic_block *bb, struct pseudo *pseudo);
+int bb_depends_on(struct basic_block *target, struct basic_block *src);
+
 #endif
@@ -17,6 +17,194 @@
 #include "simplify.h"
 #include "flow.h"
 
+///
+// index of the memory accesses
+// ----------------------------
+// For each run of simplify_memops(), the memory accesses of each block
+// are indexed by address (alias class): two different symbols never
+// alias (see distinct_symbols()), so only the accesses to the same
+// symbol and, if the symbol is not local, calls and accesses via a
+// non-symbol address can interfere with the accesses to a symbol.
+// Asm statements touching the memory interfere with everything.
+//
+// The index also remembers the blocks from which a search for
+// a dominating access has failed, in order to not redo it for each
+// load of the same location.
+enum memops_kind {
+	MEMOPS_BLOCK,			// all the accesses of the block
+	MEMOPS_CLASS,			// the block's accesses to @addr
+	MEMOPS_FAILED,			// no dominating access above the block
+};
+
+struct memops_entry {
+	struct basic_block *bb;
+	pseudo_t addr;
+	long long offset;
+	unsigned int size;
+	enum memops_kind kind:2;
+	unsigned int barrier:1;		// calls or non-symbol accesses
+	unsigned int asm_memory:1;	// asm touching the memory
+	struct instruction_list *ops;
+};
+
+// open-addressing table, with linear probing
+static struct memops_entry *memops_table;
+static unsigned int memops_size, memops_nr;
+
+static unsigned long memops_hash(struct basic_block *bb, pseudo_t addr, long long offset, unsigned int size, enum memops_kind kind)
+{
+	unsigned long hash = hashval(bb);
+
+	hash = hash * 31 + hashval(addr);
+	hash = hash * 31 + offset;
+	hash = hash * 31 + size;
+	hash = hash * 4 + kind;
+	return (hash * 0x9E3779B97F4A7C15ULL) >> (64 - __builtin_ctz(memops_size));
+}
+
+static struct memops_entry *memops_slot(struct basic_block *bb, pseudo_t addr, long long offset, unsigned int size, enum memops_kind kind)
+{
+	unsigned int slot = memops_hash(bb, addr, offset, size, kind);
+	struct memops_entry *entry;
+
+	while ((entry = &memops_table[slot])->bb) {
+		if (entry->bb == bb && entry->addr == addr && entry->kind == kind &&
+		    entry->offset == offset && entry->size == size)
+			break;
+		slot = (slot + 1) & (memops_size - 1);
+	}
+	return entry;
+}
+
+static void memops_resize(unsigned int size)
+{
+	struct memops_entry *old = memops_table;
+	unsigned int old_size = memops_size;
+	unsigned int i;
+
+	memops_table = calloc(size, sizeof(*memops_table));
+	if (!memops_table)
+		die("out of memory");
+	memops_size = size;
+	for (i = 0; i < old_size; i++) {
+		struct memops_entry *entry = &old[i];
+
+		if (entry->bb)
+			*memops_slot(entry->bb, entry->addr, entry->offset, entry->size, entry->kind) = *entry;
+	}
+	free(old);
+}
+
+static struct memops_entry *memops_lookup(struct basic_block *bb, pseudo_t addr, long long offset, unsigned int size, enum memops_kind kind)
+{
+	struct memops_entry *entry = memops_slot(bb, addr, offset, size, kind);
+
+	return entry->bb ? entry : NULL;
+}
+
+static struct memops_entry *memops_add(struct basic_block *bb, pseudo_t addr, long long offset, unsigned int size, enum memops_kind kind)
+{
+	struct memops_entry *entry;
+
+	if (memops_nr >= memops_size / 2)
+		memops_resize(memops_size ? memops_size * 2 : 1024);
+	entry = memops_slot(bb, addr, offset, size, kind);
+	if (!entry->bb) {
+		entry->bb = bb;
+		entry->addr = addr;
+		entry->offset = offset;
+		entry->size = size;
+		entry->kind = kind;
+		memops_nr++;
+	}
+	return entry;
+}
+
+static void memops_index(struct entrypoint *ep)
+{
+	struct basic_block *bb;
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct memops_entry *block = memops_add(bb, NULL, 0, 0, MEMOPS_BLOCK);
+		struct instruction *insn;
+
+		FOR_EACH_PTR(bb->insns, insn) {
+			struct memops_entry *class;
+
+			if (!insn->bb)
+				continue;
+			switch (insn->opcode) {
+			case OP_LOAD: case OP_STORE:
+				if (insn->src->type != PSEUDO_SYM)
+					block->barrier = 1;
+				class = memops_add(bb, insn->src, 0, 0, MEMOPS_CLASS);
+				add_instruction(&class->ops, insn);
+				// the table may have been resized
+				block = memops_lookup(bb, NULL, 0, 0, MEMOPS_BLOCK);
+				break;
+			case OP_CALL: case OP_ENTRY:
+				block->barrier = 1;
+				break;
+			case OP_ASM:
+				if (!insn->clobber_memory && !insn->output_memory)
+					continue;
+				block->asm_memory = 1;
+				break;
+			default:
+				continue;
+			}
+			add_instruction(&block->ops, insn);
+		} END_FOR_EACH_PTR(insn);
+	} END_FOR_EACH_PTR(bb);
+}
+
+static void memops_clear(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < memops_size; i++)
+		free_ptr_list(&memops_table[i].ops);
+	free(memops_table);
+	memops_table = NULL;
+	memops_size = memops_nr = 0;
+}
+
+///
+// the memory accesses of a block which may interfere with an address
+// @return: the accesses, in order, or all the block's instructions
+//	if the accesses are not indexed.
+struct instruction_list *memops_list(struct basic_block *bb, pseudo_t addr, int local)
+{
+	struct memops_entry *block, *class;
+
+	if (!memops_table)
+		return bb->insns;
+	block = memops_lookup(bb, NULL, 0, 0, MEMOPS_BLOCK);
+	if (!block)				// a new block?
+		return bb->insns;
+	if (addr->type != PSEUDO_SYM || block->asm_memory)
+		return block->ops;
+	if (!local && block->barrier)
+		return block->ops;
+	class = memops_lookup(bb, addr, 0, 0, MEMOPS_CLASS);
+	return class ? class->ops : NULL;
+}
+
+// Only the joins are remembered, the other blocks lead to them.
+static bool memops_failed(struct basic_block *bb, struct instruction *insn)
+{
+	if (!ptr_list_multiple((struct ptr_list *)bb->parents))
+		return false;
+	return memops_lookup(bb, insn->src, insn->offset, insn->size, MEMOPS_FAILED);
+}
+
+static void memops_set_failed(struct basic_block *bb, struct instruction *insn)
+{
+	if (!ptr_list_multiple((struct ptr_list *)bb->parents))
+		return;
+	memops_add(bb, insn->src, insn->offset, insn->size, MEMOPS_FAILED);
+}
+
 static void rewrite_load_instruction(struct instruction *insn, struct pseudo_list *dominators)
 {
 	pseudo_t new = NULL;
@@ -53,28 +241,36 @@ end:
 	repeat_phase |= REPEAT_CSE;
 }
 
+// set if the current search has met the load it's done for
+static bool search_looped;
+
 static int find_dominating_parents(struct instruction *insn,
 	struct basic_block *bb, struct pseudo_list **dominators,
 	int local)
 {
 	struct basic_block *parent;
 
+	if (memops_failed(bb, insn))
+		return 0;
+
 	FOR_EACH_PTR(bb->parents, parent) {
 		struct instruction *phisrc;
 		struct instruction *one;
 		pseudo_t phi;
 
-		FOR_EACH_PTR_REVERSE(parent->insns, one) {
+		FOR_EACH_PTR_REVERSE(memops_list(parent, insn->src, local), one) {
 			int dominance;
 			if (!one->bb)
 				continue;
-			if (one == insn)
+			if (one == insn) {
+				search_looped = true;
 				goto no_dominance;
+			}
 			dominance = dominates(insn, one, local);
 			if (dominance < 0) {
 				if (one->opcode == OP_LOAD)
 					continue;
-				return 0;
+				goto failed;
 			}
 			if (!dominance)
 				continue;
@@ -86,7 +282,7 @@ no_dominance:
 		parent->generation = bb->generation;
 
 		if (!find_dominating_parents(insn, parent, dominators, local))
-			return 0;
+			goto failed;
 		continue;
 
 found_dominator:
@@ -98,7 +294,14 @@ found_dominator:
 		use_pseudo(insn, phi, add_pseudo(dominators, phi));
 	} END_FOR_EACH_PTR(parent);
 	return 1;
-}		
+
+failed:
+	// the same search from this block would fail for the other loads
+	// of the same location (but a loop may have hidden some accesses)
+	if (!search_looped)
+		memops_set_failed(bb, insn);
+	return 0;
+}
 
 static int address_taken(pseudo_t pseudo)
 {
@@ -131,9 +334,10 @@ static bool compatible_loads(struct instruction *a, struct instruction *b)
 
 static void simplify_loads(struct basic_block *bb)
 {
+	struct memops_entry *block = memops_lookup(bb, NULL, 0, 0, MEMOPS_BLOCK);
 	struct instruction *insn;
 
-	FOR_EACH_PTR_REVERSE(bb->insns, insn) {
+	FOR_EACH_PTR_REVERSE(block->ops, insn) {
 		if (!insn->bb)
 			continue;
 		if (insn->opcode == OP_LOAD) {
@@ -173,6 +377,7 @@ static void simplify_loads(struct basic_block *bb)
 			/* OK, go find the parents */
 			bb->generation = ++bb_generation;
 			dominators = NULL;
+			search_looped = false;
 			if (find_dominating_parents(insn, bb, &dominators, local)) {
 				/* This happens with initial assignments to structures etc.. */
 				if (!dominators) {
@@ -223,9 +428,10 @@ static bool try_to_kill_store(struct instruction *insn,
 
 static void kill_dominated_stores(struct basic_block *bb)
 {
+	struct memops_entry *block = memops_lookup(bb, NULL, 0, 0, MEMOPS_BLOCK);
 	struct instruction *insn;
 
-	FOR_EACH_PTR_REVERSE(bb->insns, insn) {
+	FOR_EACH_PTR_REVERSE(block->ops, insn) {
 		if (!insn->bb)
 			continue;
 		if (insn->opcode == OP_STORE) {
@@ -252,7 +458,7 @@ static void kill_dominated_stores(struct basic_block *bb)
 
 				if (bb_list_size(par->children) != 1)
 					goto next_parent;
-				FOR_EACH_PTR(par->insns, dom) {
+				FOR_EACH_PTR(memops_list(par, pseudo, local), dom) {
 					if (!dom->bb)
 						continue;
 					if (dom == insn)
@@ -274,6 +480,7 @@ void simplify_memops(struct entrypoint *ep)
 	struct basic_block *bb;
 	pseudo_t pseudo;
 
+	memops_index(ep);
 	FOR_EACH_PTR_REVERSE(ep->bbs, bb) {
 		simplify_loads(bb);
 	} END_FOR_EACH_PTR_REVERSE(bb);
@@ -292,4 +499,5 @@ void simplify_memops(struct entrypoint *ep)
 			continue;
 		kill_dead_stores(ep, pseudo, local_pseudo(pseudo));
 	} END_FOR_EACH_PTR(pseudo);
+	memops_clear();
 }
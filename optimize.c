@@ -17,8 +17,11 @@
 #include "cse.h"
 #include "ir.h"
 #include "ssa.h"
+#include "sccp.h"
+#include "stats.h"
 
 int repeat_phase;
+unsigned long insns_visited;
 
 static void clear_symbol_pseudos(struct entrypoint *ep)
 {
@@ -30,7 +33,117 @@ static void clear_symbol_pseudos(struct entrypoint *ep)
 }
 
 
-static void clean_up_insns(struct entrypoint *ep)
+///
+// worklist of the instructions to simplify
+//
+// Only the instructions whose operands or whose users may have changed
+// are (re)visited: the changed instructions, the users of the pseudos
+// they define or which have been replaced and the definitions of their
+// operands. Instructions are queued only while optimizing.
+static struct instruction_list *worklist;
+static int worklist_active;
+
+static void add_to_worklist(struct instruction *insn)
+{
+	if (insn->queued)
+		return;
+	insn->queued = 1;
+	add_instruction(&worklist, insn);
+}
+
+void queue_insn(struct instruction *insn)
+{
+	if (!worklist_active || !insn)
+		return;
+	// phi-nodes look through their phi-sources
+	if (insn->opcode == OP_PHISOURCE)
+		queue_users(insn->target);
+	add_to_worklist(insn);
+}
+
+void queue_users(pseudo_t pseudo)
+{
+	struct pseudo_user *pu;
+
+	if (!worklist_active || !has_use_list(pseudo))
+		return;
+	FOR_EACH_PTR(pseudo->users, pu) {
+		queue_insn(pu->insn);
+	} END_FOR_EACH_PTR(pu);
+}
+
+static void queue_def(pseudo_t pseudo)
+{
+	if (pseudo && has_definition(pseudo))
+		queue_insn(pseudo->def);
+}
+
+static void queue_def_list(struct pseudo_list *list)
+{
+	pseudo_t pseudo;
+
+	FOR_EACH_PTR(list, pseudo) {
+		queue_def(pseudo);
+	} END_FOR_EACH_PTR(pseudo);
+}
+
+// queue what may be affected by a change to this instruction
+static void queue_neighbours(struct instruction *insn)
+{
+	if (!insn->bb)
+		return;
+
+	// roughly in the program order: the definitions first
+	switch (insn->opcode) {
+	case OP_SEL:
+	case OP_RANGE:
+		queue_def(insn->src3);
+		/* fall through */
+	case OP_BINARY ... OP_BINCMP_END:
+		queue_def(insn->src2);
+		/* fall through */
+	case OP_UNOP ... OP_UNOP_END:
+	case OP_SLICE:
+	case OP_PHISOURCE:
+	case OP_SYMADDR:
+	case OP_CBR:
+	case OP_SWITCH:
+	case OP_COMPUTEDGOTO:
+	case OP_LOAD:
+		queue_def(insn->src1);
+		break;
+	case OP_STORE:
+		queue_def(insn->src);
+		queue_def(insn->target);
+		break;
+	case OP_PHI:
+		queue_def_list(insn->phi_list);
+		break;
+	case OP_CALL:
+		queue_def(insn->func);
+		queue_def_list(insn->arguments);
+		break;
+	}
+	queue_insn(insn);
+	if (opcode_table[insn->opcode].flags & OPF_TARGET)
+		queue_users(insn->target);
+}
+
+static void queue_all_insns(struct entrypoint *ep)
+{
+	struct basic_block *bb;
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *insn;
+		FOR_EACH_PTR(bb->insns, insn) {
+			if (insn->bb)
+				add_to_worklist(insn);
+		} END_FOR_EACH_PTR(insn);
+	} END_FOR_EACH_PTR(bb);
+}
+
+// the phi-nodes and the branches depend on the CFG
+static void queue_cfg_insns(struct entrypoint *ep)
 {
 	struct basic_block *bb;
 
@@ -39,28 +152,85 @@ static void clean_up_insns(struct entrypoint *ep)
 		FOR_EACH_PTR(bb->insns, insn) {
 			if (!insn->bb)
 				continue;
-			repeat_phase |= simplify_instruction(insn);
+			if (insn->opcode != OP_PHI)
+				break;
+			queue_insn(insn);
+		} END_FOR_EACH_PTR(insn);
+		queue_insn(last_instruction(bb->insns));
+	} END_FOR_EACH_PTR(bb);
+}
+
+static void clear_worklist(void)
+{
+	struct instruction *insn;
+
+	FOR_EACH_PTR(worklist, insn) {
+		insn->queued = 0;
+	} END_FOR_EACH_PTR(insn);
+	free_ptr_list(&worklist);
+}
+
+static void clean_up_insns(struct entrypoint *ep)
+{
+	struct instruction_list *list;
+
+	while ((list = worklist)) {
+		struct instruction *insn;
+
+		worklist = NULL;
+		FOR_EACH_PTR(list, insn) {
+			int repeat = repeat_phase;
+			int changed;
+
+			insn->queued = 0;
 			if (!insn->bb)
 				continue;
-			assert(insn->bb == bb);
-			cse_collect(insn);
+			insns_visited++;
+			// some changes are only reported via repeat_phase
+			repeat_phase = 0;
+			changed = simplify_instruction(insn) | repeat_phase;
+			repeat_phase = repeat | changed;
+			if (changed)
+				queue_neighbours(insn);
 		} END_FOR_EACH_PTR(insn);
-	} END_FOR_EACH_PTR(bb);
+		free_ptr_list(&list);
+	}
 }
 
 static void cleanup_cfg(struct entrypoint *ep)
 {
 	kill_unreachable_bbs(ep);
-	domtree_build(ep);
+	// the dominance tree has been kept up to date
+	cfg_postorder(ep);
+	domtree_verify(ep);
 }
 
 ///
 // optimization main loop
+static void timed_memops(struct entrypoint *ep)
+{
+	phase_start(PHASE_MEMOPS);
+	simplify_memops(ep);
+	phase_end(PHASE_MEMOPS);
+}
+
+static int timed_flow(struct entrypoint *ep)
+{
+	int changed;
+
+	phase_start(PHASE_FLOW);
+	changed = simplify_flow(ep);
+	phase_end(PHASE_FLOW);
+	return changed;
+}
+
 void optimize(struct entrypoint *ep)
 {
 	if (fdump_ir & PASS_LINEARIZE)
 		show_entry(ep);
 
+	phase_start(PHASE_OPTIMIZE);
+
 	/*
 	 * Do trivial flow simplification - branches to
 	 * branches, kill dead basicblocks etc
@@ -78,33 +248,58 @@ void optimize(struct entrypoint *ep)
 	/*
 	 * Turn symbols into pseudos
 	 */
-	if (fpasses & PASS_MEM2REG)
+	if (fpasses & PASS_MEM2REG) {
+		phase_start(PHASE_SSA);
 		ssa_convert(ep);
+		phase_end(PHASE_SSA);
+	}
 	ir_validate(ep);
 	if (fdump_ir & PASS_MEM2REG)
 		show_entry(ep);
 
+	/*
+	 * Propagate the constants and remove the branches
+	 * which can't be taken.
+	 */
+	if (fpasses & PASS_SCCP) {
+		phase_start(PHASE_SCCP);
+		if (sccp(ep) & REPEAT_CFG_CLEANUP)
+			cleanup_cfg(ep);
+		phase_end(PHASE_SCCP);
+		ir_validate(ep);
+		if (fdump_ir & PASS_SCCP)
+			show_entry(ep);
+	}
+
 	if (!(fpasses & PASS_OPTIM))
-		return;
+		goto out;
+	worklist_active = 1;
 repeat:
+	queue_all_insns(ep);
 	/*
 	 * Remove trivial instructions, and try to CSE
 	 * the rest.
 	 */
 	do {
-		simplify_memops(ep);
+		timed_memops(ep);
 		do {
 			repeat_phase = 0;
 			clean_up_insns(ep);
-			if (repeat_phase & REPEAT_CFG_CLEANUP)
+			if (repeat_phase & REPEAT_CFG_CLEANUP) {
 				kill_unreachable_bbs(ep);
+				queue_cfg_insns(ep);
+			}
 
+			phase_start(PHASE_CSE);
 			cse_eliminate(ep);
-			simplify_memops(ep);
+			phase_end(PHASE_CSE);
+			timed_memops(ep);
 		} while (repeat_phase);
 		pack_basic_blocks(ep);
 		if (repeat_phase & REPEAT_CFG_CLEANUP)
 			cleanup_cfg(ep);
+		if (repeat_phase)
+			queue_all_insns(ep);
 	} while (repeat_phase);
 
 	vrfy_flow(ep);
@@ -113,7 +308,9 @@ repeat:
 	clear_symbol_pseudos(ep);
 
 	/* And track pseudo register usage */
+	phase_start(PHASE_LIVENESS);
 	track_pseudo_liveness(ep);
+	phase_end(PHASE_LIVENESS);
 
 	/*
 	 * Some flow optimizations can only effectively
@@ -121,7 +318,7 @@ repeat:
 	 * if they trigger, we need to start all over
 	 * again
 	 */
-	if (simplify_flow(ep)) {
+	if (timed_flow(ep)) {
 		clear_liveness(ep);
 		if (repeat_phase & REPEAT_CFG_CLEANUP)
 			cleanup_cfg(ep);
@@ -131,4 +328,8 @@ repeat:
 	/* Finally, add deathnotes to pseudos now that we have them */
 	if (dbg_dead)
 		track_pseudo_death(ep);
+	worklist_active = 0;
+	clear_worklist();
+out:
+	phase_end(PHASE_OPTIMIZE);
 }
@@ -6,4 +6,7 @@ struct entrypoint;
 /* optimize.c */
 void optimize(struct entrypoint *ep);
 
+// number of instructions visited by the simplification
+extern unsigned long insns_visited;
+
 #endif
@@ -35,10 +35,12 @@ int gcc_major = __GNUC__;
 int gcc_minor = __GNUC_MINOR__;
 int gcc_patchlevel = __GNUC_PATCHLEVEL__;
 int has_error = 0;
+unsigned int jobs = 1;
 int optimize_level;
 int optimize_size;
 int preprocess_only;
 int preprocessing;
+const char *server_path;
 int verbose;
 
 #define CMDLINE_INCLUDE 20
@@ -77,11 +79,13 @@ int fhosted = 1;
 unsigned int fmax_errors = 100;
 unsigned int fmax_warnings = 100;
 int fmem_report = 0;
+unsigned int ftime_report = 0;
 unsigned long long fmemcpy_max_count = 100000;
 unsigned long fpasses = ~0UL;
 int fpic = 0;
 int fpie = 0;
 int fshort_wchar = 0;
+const char *ftoken_cache_dir = NULL;
 int funsigned_bitfields = 0;
 int funsigned_char = 0;
 
@@ -488,6 +492,7 @@ static int handle_fdump_ir(const char *arg, const char *opt, const struct flag *
 		{ "",			PASS_LINEARIZE },
 		{ "linearize",		PASS_LINEARIZE },
 		{ "mem2reg",		PASS_MEM2REG },
+		{ "sccp",		PASS_SCCP },
 		{ "final",		PASS_FINAL },
 		{ },
 	};
@@ -513,6 +518,30 @@ static int handle_fmax_warnings(const char *arg, const char *opt, const struct f
 	return 1;
 }
 
+static int handle_ftoken_cache_dir(const char *arg, const char *opt, const struct flag *flag, int options)
+{
+	if (*opt == '\0')
+		die("error: missing argument to \"%s\"", arg);
+	ftoken_cache_dir = opt;
+	return 1;
+}
+
+static int handle_ftime_report(const char *arg, const char *opt, const struct flag *flag, int options)
+{
+	switch (*opt) {
+	case '\0':
+		ftime_report = 10;
+		return 1;
+	case '=':
+		opt_uint(arg, opt + 1, &ftime_report, 0);
+		if (!ftime_report)
+			ftime_report = 1;
+		return 1;
+	default:
+		return 0;
+	}
+}
+
 static struct flag fflags[] = {
 	{ "diagnostic-prefix",	NULL,	handle_fdiagnostic_prefix },
 	{ "dump-ir",		NULL,	handle_fdump_ir },
@@ -524,8 +553,11 @@ static struct flag fflags[] = {
 	{ "mem-report",		&fmem_report },
 	{ "memcpy-max-count=",	NULL,	handle_fmemcpy_max_count },
 	{ "tabstop=",		NULL,	handle_ftabstop },
+	{ "time-report",	NULL,	handle_ftime_report },
+	{ "token-cache-dir=",	NULL,	handle_ftoken_cache_dir },
 	{ "mem2reg",		NULL,	handle_fpasses,	PASS_MEM2REG },
 	{ "optim",		NULL,	handle_fpasses,	PASS_OPTIM },
+	{ "sccp",		NULL,	handle_fpasses,	PASS_SCCP },
 	{ "pic",		&fpic,	handle_switch_setval, 1 },
 	{ "PIC",		&fpic,	handle_switch_setval, 2 },
 	{ "pie",		&fpie,	handle_switch_setval, 1 },
@@ -617,6 +649,21 @@ static char **handle_switch_i(char *arg, char **next)
 	return next;
 }
 
+static char **handle_switch_j(char *arg, char **next)
+{
+	char *val = arg + 1;
+
+	if (*val == '\0') {	// "-j N"
+		val = *++next;
+		if (!val)
+			die("missing argument for -j option");
+	}
+	opt_uint("-j", val, &jobs, 0);
+	if (!jobs)
+		jobs = 1;
+	return next;
+}
+
 static char **handle_switch_M(char *arg, char **next)
 {
 	if (!strcmp(arg, "MF") || !strcmp(arg,"MQ") || !strcmp(arg,"MT")) {
@@ -979,6 +1026,16 @@ static char **handle_param(char *arg, char **next)
 	return next;
 }
 
+static char **handle_server(char *arg, char **next)
+{
+	if (*arg++ != '=' || !*arg)
+		die("missing argument for --server option");
+
+	server_path = arg;
+
+	return next;
+}
+
 static char **handle_os(char *arg, char **next)
 {
 	if (*arg++ != '=')
@@ -1007,6 +1064,7 @@ static char **handle_long_options(char *arg, char **next)
 		{ "arch", handle_arch, 1 },
 		{ "os",   handle_os, 1 },
 		{ "param", handle_param, 1 },
+		{ "server", handle_server, 1 },
 		{ "version", handle_version },
 		{ NULL, NULL }
 	};
@@ -1033,6 +1091,7 @@ char **handle_switch(char *arg, char **next)
 	case 'G': return handle_switch_G(arg, next);
 	case 'I': return handle_switch_I(arg, next);
 	case 'i': return handle_switch_i(arg, next);
+	case 'j': return handle_switch_j(arg, next);
 	case 'M': return handle_switch_M(arg, next);
 	case 'm': return handle_switch_m(arg, next);
 	case 'n': return handle_switch_n(arg, next);
@@ -34,11 +34,13 @@ extern int do_output;
 extern int gcc_major;
 extern int gcc_minor;
 extern int gcc_patchlevel;
+extern unsigned int jobs;
 extern int optimize_level;
 extern int optimize_size;
 extern int preprocess_only;
 extern int preprocessing;
 extern int repeat_phase;
+extern const char *server_path;
 extern int verbose;
 
 extern int cmdline_include_nr;
@@ -77,11 +79,13 @@ extern int fhosted;
 extern unsigned int fmax_errors;
 extern unsigned int fmax_warnings;
 extern int fmem_report;
+extern unsigned int ftime_report;
 extern unsigned long long fmemcpy_max_count;
 extern unsigned long fpasses;
 extern int fpic;
 extern int fpie;
 extern int fshort_wchar;
+extern const char *ftoken_cache_dir;
 extern int funsigned_bitfields;
 extern int funsigned_char;
 
@@ -124,9 +124,18 @@ static void replace_with_integer(struct token *token, unsigned int val)
 	token->number = buf;
 }
 
+// the current binding of a macro, even if #undef'ed
+static struct symbol *macro_binding(struct ident *ident)
+{
+	struct symbol *sym = ident->macros;
+	if (sym)
+		sym->used = 1;
+	return sym;
+}
+
 static struct symbol *lookup_macro(struct ident *ident)
 {
-	struct symbol *sym = lookup_symbol(ident, NS_MACRO | NS_UNDEF);
+	struct symbol *sym = macro_binding(ident);
 	if (sym && sym->namespace != NS_MACRO)
 		sym = NULL;
 	return sym;
@@ -237,8 +246,10 @@ static inline struct token *scan_next(struct token **where)
 	if (token_type(token) != TOKEN_UNTAINT)
 		return token;
 	do {
+		struct token *next = token->next;
 		token->ident->tainted = 0;
-		token = token->next;
+		__free_token(token);	/* the marker isn't needed anymore */
+		token = next;
 	} while (token_type(token) == TOKEN_UNTAINT);
 	*where = token;
 	return token;
@@ -350,6 +361,7 @@ static int collect_arguments(struct token *start, struct token *arglist, struct
 				count++;
 				break;
 			}
+			__free_token(start);	/* the '(' or the previous ',' */
 			start = next;
 		}
 		if (count == wanted && !match_op(next, ')'))
@@ -367,6 +379,10 @@ static int collect_arguments(struct token *start, struct token *arglist, struct
 			goto Efew;
 	}
 	what->next = next->next;
+	if (match_op(next, ')')) {
+		__free_token(start);
+		__free_token(next);
+	}
 	return 1;
 
 Efew:
@@ -391,6 +407,15 @@ out:
 	return 0;
 }
 
+static void free_token_list(struct token *list)
+{
+	while (list && !eof_token(list)) {
+		struct token *next = list->next;
+		__free_token(list);
+		list = next;
+	}
+}
+
 static struct token *dup_list(struct token *list)
 {
 	struct token *res = NULL;
@@ -751,6 +776,7 @@ static int expand(struct token **list, struct symbol *sym)
 	struct token *expansion = sym->expansion;
 	int nargs = sym->arglist ? sym->arglist->count.normal : 0;
 	struct arg args[nargs];
+	int i;
 
 	if (expanding->tainted) {
 		token->pos.noexpand = 1;
@@ -768,6 +794,12 @@ static int expand(struct token **list, struct symbol *sym)
 	if (sym->expand)
 		return sym->expand(token, args) ? 0 : 1;
 
+	// the arguments only used stringified are not needed anymore
+	for (i = 0; i < nargs; i++) {
+		if (!args[i].n_normal && !args[i].n_quoted)
+			free_token_list(args[i].arg);
+	}
+
 	expanding->tainted = 1;
 
 	last = token->next;
@@ -781,6 +813,7 @@ static int expand(struct token **list, struct symbol *sym)
 	(*list)->pos.newline = token->pos.newline;
 	(*list)->pos.whitespace = token->pos.whitespace;
 	*tail = last;
+	__free_token(token);
 
 	return 0;
 }
@@ -896,8 +929,76 @@ static void set_stream_include_path(struct stream *stream)
 	includepath[0] = path;
 }
 
+/*
+ * Cache of the headers known to be absent.
+ *
+ * Each #include is searched in most of the include directories
+ * before being found, and the same headers are included again and
+ * again, so most of the open() calls done for the includes fail.
+ * Remember the full names which couldn't be opened, for the whole
+ * process, so that the next searches can skip them directly.
+ * Since it's keyed by the full name, it's also valid for the searches
+ * done by #include_next, which only start at another directory.
+ */
+#define INCLUDE_HASH_BITS	12
+#define INCLUDE_HASH_SIZE	(1 << INCLUDE_HASH_BITS)
+
+struct missing_include {
+	struct missing_include *next;
+	unsigned int hash;
+	int len;
+	char name[];
+};
+
+DECLARE_ALLOCATOR(missing_include);
+ALLOCATOR(missing_include, "missing includes");
+
+static struct missing_include *missing_includes[INCLUDE_HASH_SIZE];
+static unsigned long include_hits, include_misses, include_absent;
+
+static unsigned int hash_include(const char *name, int len)
+{
+	unsigned int hash = 0;
+
+	while (len--)
+		hash = (hash + (*name++ << 4)) * 11;
+	return hash;
+}
+
+static struct missing_include **lookup_missing_include(const char *name, int len, unsigned int hash)
+{
+	struct missing_include **p = &missing_includes[hash & (INCLUDE_HASH_SIZE - 1)];
+	struct missing_include *m;
+
+	while ((m = *p) != NULL) {
+		if (m->hash == hash && m->len == len && !memcmp(m->name, name, len))
+			break;
+		p = &m->next;
+	}
+	return p;
+}
+
+static void add_missing_include(struct missing_include **p, const char *name, int len, unsigned int hash)
+{
+	struct missing_include *m = __alloc_missing_include(len);
+
+	m->next = NULL;
+	m->hash = hash;
+	m->len = len;
+	memcpy(m->name, name, len);
+	*p = m;
+}
+
+void show_include_cache_stats(void)
+{
+	fprintf(stderr, "include cache: %lu hits, %lu misses, %lu absent headers\n",
+		include_hits, include_misses, include_absent);
+}
+
 static int try_include(struct position pos, const char *path, const char *filename, int flen, struct token **where, const char **next_path)
 {
+	struct missing_include **missing;
+	unsigned int hash;
 	int fd;
 	int plen = strlen(path);
 	static char fullname[PATH_MAX];
@@ -908,6 +1009,15 @@ static int try_include(struct position pos, const char *path, const char *filena
 		plen++;
 	}
 	memcpy(fullname+plen, filename, flen);
+
+	// flen includes the terminating null char
+	hash = hash_include(fullname, plen + flen);
+	missing = lookup_missing_include(fullname, plen + flen, hash);
+	if (*missing) {
+		include_hits++;
+		return 0;
+	}
+	include_misses++;
 	if (already_tokenized(fullname))
 		return 1;
 	fd = open(fullname, O_RDONLY);
@@ -917,6 +1027,8 @@ static int try_include(struct position pos, const char *path, const char *filena
 		close(fd);
 		return 1;
 	}
+	include_absent++;
+	add_missing_include(missing, fullname, plen + flen, hash);
 	return 0;
 }
 
@@ -1352,7 +1464,7 @@ static int do_define(struct position pos, struct token *token, struct ident *nam
 	if (!expansion)
 		return 1;
 
-	sym = lookup_symbol(name, NS_MACRO | NS_UNDEF);
+	sym = macro_binding(name);
 	if (sym) {
 		int clean;
 
@@ -1522,7 +1634,7 @@ static int do_handle_undef(struct stream *stream, struct token **line, struct to
 		return 1;
 	}
 
-	sym = lookup_symbol(left->ident, NS_MACRO | NS_UNDEF);
+	sym = macro_binding(left->ident);
 	if (sym) {
 		if (attr < sym->attr)
 			return 1;
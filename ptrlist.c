@@ -31,6 +31,104 @@
 __DECLARE_ALLOCATOR(struct ptr_list, ptrlist);
 __ALLOCATOR(struct ptr_list, "ptr list", ptrlist);
 
+// The big nodes of the vector lists, one allocator per order.
+static struct allocator_struct ptrvec_allocators[PTR_LIST_MAX_ORDER + 1] = {
+	[1 ... PTR_LIST_MAX_ORDER] = {
+		.name = "ptr vector",
+		.alignment = __alignof__(struct ptr_list),
+		.chunking = CHUNK,
+	},
+};
+
+// The nodes of the IR lists, kept apart so that they can be released
+// with the rest of the IR without touching the other lists.
+static struct allocator_struct ir_ptrlist_allocators[PTR_LIST_MAX_ORDER + 1] = {
+	[0 ... PTR_LIST_MAX_ORDER] = {
+		.name = "ir ptr list",
+		.alignment = __alignof__(struct ptr_list),
+		.chunking = CHUNK,
+	},
+};
+
+static struct allocator_struct *node_allocator(int order, int kind)
+{
+	if (kind & PTR_LIST_IR)
+		return &ir_ptrlist_allocators[order];
+	return &ptrvec_allocators[order];
+}
+
+static struct ptr_list *alloc_node(int order, int kind)
+{
+	struct ptr_list *node;
+
+	if (!order && !(kind & PTR_LIST_IR))
+		node = __alloc_ptrlist(0);
+	else
+		node = allocate(node_allocator(order, kind), sizeof(*node) << order);
+	node->order = order;
+	node->kind = kind;
+	return node;
+}
+
+static void free_node(struct ptr_list *node)
+{
+	if (!node->order && !(node->kind & PTR_LIST_IR))
+		__free_ptrlist(node);
+	else
+		free_one_entry(node_allocator(node->order, node->kind), node);
+}
+
+// the order of the node to add after @last
+static int next_order(struct ptr_list *last)
+{
+	if (!(last->kind & PTR_LIST_GROWING))
+		return 0;
+	if (last->order < PTR_LIST_MAX_ORDER)
+		return last->order + 1;
+	return PTR_LIST_MAX_ORDER;
+}
+
+void mark_ir_ptrlists(void)
+{
+	int i;
+
+	for (i = 0; i <= PTR_LIST_MAX_ORDER; i++)
+		mark_allocations(&ir_ptrlist_allocators[i]);
+}
+
+void release_ir_ptrlists(void)
+{
+	int i;
+
+	for (i = 0; i <= PTR_LIST_MAX_ORDER; i++)
+		release_allocations(&ir_ptrlist_allocators[i]);
+}
+
+static void get_stats(struct allocator_struct *allocators, int first, struct allocator_stats *s)
+{
+	int i;
+
+	get_allocator_stats(&allocators[first], s);
+	for (i = first + 1; i <= PTR_LIST_MAX_ORDER; i++) {
+		struct allocator_stats x;
+
+		get_allocator_stats(&allocators[i], &x);
+		s->allocations += x.allocations;
+		s->useful_bytes += x.useful_bytes;
+		s->total_bytes += x.total_bytes;
+	}
+}
+
+void get_ptrvec_stats(struct allocator_stats *s)
+{
+	get_stats(ptrvec_allocators, 1, s);
+}
+
+void get_ir_ptrlist_stats(struct allocator_stats *s)
+{
+	get_stats(ir_ptrlist_allocators, 0, s);
+}
+
 ///
 // get the size of a ptrlist
 // @head: the head of the list
@@ -99,12 +197,16 @@ void *first_ptr_list(struct ptr_list *head)
 	if (!head)
 		return NULL;
 
-	while (list->nr == 0) {
-		list = list->next;
-		if (list == head)
-			return NULL;
-	}
-	return PTR_ENTRY_NOTAG(list, 0);
+	do {
+		int i;
+
+		for (i = 0; i < list->nr; i++) {
+			void *ptr = PTR_ENTRY_NOTAG(list, i);
+			if (ptr || !list->rm)
+				return ptr;
+		}
+	} while ((list = list->next) != head);
+	return NULL;
 }
 
 ///
@@ -117,13 +219,18 @@ void *last_ptr_list(struct ptr_list *head)
 
 	if (!head)
 		return NULL;
-	list = head->prev;
-	while (list->nr == 0) {
-		if (list == head)
-			return NULL;
+	list = head;
+	do {
+		int i;
+
 		list = list->prev;
-	}
-	return PTR_ENTRY_NOTAG(list, list->nr-1);
+		for (i = list->nr; --i >= 0;) {
+			void *ptr = PTR_ENTRY_NOTAG(list, i);
+			if (ptr || !list->rm)
+				return ptr;
+		}
+	} while (list != head);
+	return NULL;
 }
 
 ///
@@ -138,12 +245,20 @@ void *ptr_list_nth_entry(struct ptr_list *list, unsigned int idx)
 		return NULL;
 
 	do {
-		unsigned int nr = list->nr;
+		unsigned int nr = list->nr - list->rm;
 
-		if (idx < nr)
-			return list->list[idx];
-		else
+		if (idx >= nr) {
 			idx -= nr;
+			continue;
+		}
+		if (!list->rm)
+			return list->list[idx];
+		for (nr = 0;; nr++) {
+			if (!list->list[nr])
+				continue;
+			if (!idx--)
+				return list->list[nr];
+		}
 	} while ((list = list->next) != head);
 	return NULL;
 }
@@ -170,9 +285,19 @@ int linearize_ptr_list(struct ptr_list *head, void **arr, int max)
 
 		do {
 			int i = list->nr;
-			nr += i;
+			nr += i - list->rm;
 			if (max == 0)
 				continue;
+			if (list->rm) {
+				int j;
+				for (j = 0; j < i && max; j++) {
+					if (!list->list[j])
+						continue;
+					*arr++ = list->list[j];
+					max--;
+				}
+				continue;
+			}
 			if (i > max) 
 				i = max;
 			memcpy(arr, list->list, i*sizeof(void *));
@@ -183,6 +308,27 @@ int linearize_ptr_list(struct ptr_list *head, void **arr, int max)
 	return nr;
 }
 
+///
+// remove the tombstones of a big node
+// @node: the node to compact
+//
+// This is only done once they are at least half of the entries,
+// so that repeated deletions & packs stay linear.
+static void compact_node(struct ptr_list *node)
+{
+	int i, nr = 0;
+
+	if (node->rm * 2 < node->nr)
+		return;
+	for (i = 0; i < node->nr; i++) {
+		void *ptr = node->list[i];
+		if (ptr)
+			node->list[nr++] = ptr;
+	}
+	node->nr = nr;
+	node->rm = 0;
+}
+
 ///
 // pack a ptrlist
 //
@@ -202,17 +348,19 @@ void pack_ptr_list(struct ptr_list **listp)
 			struct ptr_list *next;
 restart:
 			next = entry->next;
+			if (entry->order && entry->rm)
+				compact_node(entry);
 			if (!entry->nr) {
 				struct ptr_list *prev;
 				if (next == entry) {
-					__free_ptrlist(entry);
+					free_node(entry);
 					*listp = NULL;
 					return;
 				}
 				prev = entry->prev;
 				prev->next = next;
 				next->prev = prev;
-				__free_ptrlist(entry);
+				free_node(entry);
 				if (entry == head) {
 					*listp = next;
 					head = next;
@@ -235,7 +383,7 @@ restart:
 void split_ptr_list_head(struct ptr_list *head)
 {
 	int old = head->nr, nr = old / 2;
-	struct ptr_list *newlist = __alloc_ptrlist(0);
+	struct ptr_list *newlist = alloc_node(head->order, head->kind);
 	struct ptr_list *next = head->next;
 
 	old -= nr;
@@ -247,30 +395,37 @@ void split_ptr_list_head(struct ptr_list *head)
 	newlist->nr = nr;
 	memcpy(newlist->list, head->list + old, nr * sizeof(void *));
 	memset(head->list + old, 0xf0, nr * sizeof(void *));
+	if (head->rm) {
+		int i;
+		for (i = 0; i < nr; i++) {
+			if (newlist->list[i])
+				continue;
+			newlist->rm++;
+			head->rm--;
+		}
+	}
 }
 
-///
-// add an entry to a ptrlist
-// @listp: a pointer to the list
-// @ptr: the entry to add to the list
-// @return: the address where the new entry is stored.
-//
-// :note: code must not use this function and should use
-//	:func:`add_ptr_list` instead.
-void **__add_ptr_list(struct ptr_list **listp, void *ptr)
+static void **add_entry(struct ptr_list **listp, void *ptr, int kind)
 {
 	struct ptr_list *list = *listp;
-	struct ptr_list *last = NULL; /* gcc complains needlessly */
+	struct ptr_list *last = NULL;
 	void **ret;
-	int nr;
+	int nr = 0;
 
-	if (!list || (nr = (last = list->prev)->nr) >= LIST_NODE_NR) {
-		struct ptr_list *newlist = __alloc_ptrlist(0);
+	if (list) {
+		last = list->prev;
+		nr = last->nr;
+	}
+	if (!list || nr >= PTR_LIST_NODE_NR(last)) {
+		struct ptr_list *newlist;
 		if (!list) {
+			newlist = alloc_node(0, kind);
 			newlist->next = newlist;
 			newlist->prev = newlist;
 			*listp = newlist;
 		} else {
+			newlist = alloc_node(next_order(last), last->kind);
 			newlist->prev = last;
 			newlist->next = list;
 			list->prev = newlist;
@@ -286,6 +441,33 @@ void **__add_ptr_list(struct ptr_list **listp, void *ptr)
 	return ret;
 }
 
+///
+// add an entry to a ptrlist
+// @listp: a pointer to the list
+// @ptr: the entry to add to the list
+// @return: the address where the new entry is stored.
+//
+// :note: code must not use this function and should use
+//	:func:`add_ptr_list` instead.
+void **__add_ptr_list(struct ptr_list **listp, void *ptr)
+{
+	return add_entry(listp, ptr, 0);
+}
+
+///
+// add an entry to a vector or an IR list
+// @listp: a pointer to the list
+// @ptr: the entry to add to the list
+// @kind: the kind of the list, see PTR_LIST_KIND()
+// @return: the address where the new entry is stored.
+//
+// :note: code must not use this function and should use
+//	:func:`add_ptr_list` instead.
+void **__add_ptr_list_kind(struct ptr_list **listp, void *ptr, int kind)
+{
+	return add_entry(listp, ptr, kind);
+}
+
 ///
 // add a tagged entry to a ptrlist
 // @listp: a pointer to the list
@@ -387,11 +569,15 @@ void * undo_ptr_list_last(struct ptr_list **head)
 	last = first;
 	do {
 		last = last->prev;
-		if (last->nr) {
+		while (last->nr) {
 			void *ptr;
 			int nr = --last->nr;
 			ptr = last->list[nr];
 			last->list[nr] = (void *)0xf1f1f1f1;
+			if (!ptr && last->rm) {
+				last->rm--;
+				continue;
+			}
 			return ptr;
 		}
 	} while (last != first);
@@ -404,20 +590,33 @@ void * undo_ptr_list_last(struct ptr_list **head)
 // @return: the last element of the list or NULL if the list is empty.
 void * delete_ptr_list_last(struct ptr_list **head)
 {
-	void *ptr = NULL;
-	struct ptr_list *last, *first = *head;
+	void *ptr;
+	struct ptr_list *last, *first;
+	int skipped;
 
+again:
+	first = *head;
 	if (!first)
 		return NULL;
+	ptr = NULL;
+	skipped = 0;
 	last = first->prev;
-	if (last->nr)
+	while (last->nr) {
 		ptr = last->list[--last->nr];
+		if (ptr || !last->rm)
+			break;
+		last->rm--;
+		skipped = 1;
+	}
 	if (last->nr <=0) {
 		first->prev = last->prev;
 		last->prev->next = first;
 		if (last == first)
 			*head = NULL;
-		__free_ptrlist(last);
+		free_node(last);
+		// the node only had tombstones left
+		if (!ptr && skipped)
+			goto again;
 	}
 	return ptr;
 }
@@ -431,7 +630,7 @@ void concat_ptr_list(struct ptr_list *a, struct ptr_list **b)
 {
 	void *entry;
 	FOR_EACH_PTR(a, entry) {
-		add_ptr_list(b, entry);
+		add_entry(b, entry, a->kind);
 	} END_FOR_EACH_PTR(entry);
 }
 
@@ -463,9 +662,9 @@ void copy_ptr_list(struct ptr_list **listp, struct ptr_list *src)
 			void *ptr = cur->list[i++];
 			if (!ptr)
 				continue;
-			if (idx >= LIST_NODE_NR) {
+			if (idx >= PTR_LIST_NODE_NR(tail)) {
 				struct ptr_list *prev = tail;
-				tail = __alloc_ptrlist(0);
+				tail = alloc_node(next_order(prev), prev->kind);
 				prev->next = tail;
 				tail->prev = prev;
 				prev->nr = idx;
@@ -475,7 +674,7 @@ void copy_ptr_list(struct ptr_list **listp, struct ptr_list *src)
 		}
 
 		next = cur->next;
-		__free_ptrlist(cur);
+		free_node(cur);
 		cur = next;
 	} while (cur != src);
 
@@ -503,7 +702,7 @@ void __free_ptr_list(struct ptr_list **listp)
 	while (list) {
 		tmp = list;
 		list = list->next;
-		__free_ptrlist(tmp);
+		free_node(tmp);
 	}
 
 	*listp = NULL;
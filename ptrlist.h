@@ -17,17 +17,73 @@
 
 #define LIST_NODE_NR (13)
 
-#define DECLARE_PTR_LIST(listname, type)	\
+/*
+ * The nodes of a list declared with DECLARE_PTR_VECTOR() double in
+ * size each time the list needs a new one (the first node is a normal
+ * one, so small lists cost nothing more), up to 2045 entries for
+ * PTR_LIST_MAX_ORDER. A node of order 'n' is 'sizeof(struct ptr_list) << n'
+ * bytes long, its entries extend past 'list[LIST_NODE_NR]'.
+ * The entries deleted from these nodes are replaced by tombstones (see
+ * MARK_CURRENT_DELETED()) which are only removed by pack_ptr_list().
+ *
+ * The entries are never moved when the list grows, so the lists can
+ * still be appended to while being walked.
+ *
+ * Build with -DNO_PTR_VECTOR to turn them back into plain lists.
+ *
+ * The nodes of the lists declared with DECLARE_IR_PTR_LIST() or
+ * DECLARE_IR_PTR_VECTOR() have their own allocators, released with
+ * the rest of the IR of a function (see mark_ir_allocations()), so
+ * these lists must not be kept past the function. Any other list can
+ * be created while the IR is.
+ */
+#define PTR_LIST_MAX_ORDER (7)
+
+#define __DECLARE_PTR_LIST(listname, type, vec, ir)	\
 	struct listname {			\
-		int nr:8;			\
-		int rm:8;			\
+		int nr:16;			\
+		int rm:16;			\
+		unsigned char order;		\
+		unsigned char kind;		\
+		unsigned char vector_type[vec];	\
+		unsigned char ir_type[ir];	\
 		struct listname *prev;		\
 		struct listname *next;		\
 		type *list[LIST_NODE_NR];	\
 	}
 
+#define DECLARE_PTR_LIST(listname, type)	\
+	__DECLARE_PTR_LIST(listname, type, 0, 0)
+#define DECLARE_IR_PTR_LIST(listname, type)	\
+	__DECLARE_PTR_LIST(listname, type, 0, 1)
+
+#ifndef NO_PTR_VECTOR
+#define DECLARE_PTR_VECTOR(listname, type)	\
+	__DECLARE_PTR_LIST(listname, type, 1, 0)
+#define DECLARE_IR_PTR_VECTOR(listname, type)	\
+	__DECLARE_PTR_LIST(listname, type, 1, 1)
+#else
+#define DECLARE_PTR_VECTOR(listname, type)	\
+	__DECLARE_PTR_LIST(listname, type, 0, 0)
+#define DECLARE_IR_PTR_VECTOR(listname, type)	\
+	__DECLARE_PTR_LIST(listname, type, 0, 1)
+#endif
+
 DECLARE_PTR_LIST(ptr_list, void);
 
+// the number of entries a node can hold
+#define PTR_LIST_NODE_NR(node)	(LIST_NODE_NR +				\
+	((sizeof(*(node)) << (node)->order) - sizeof(*(node))) / sizeof(void *))
+// the kind of the nodes of a list, given by its declaration
+#define PTR_LIST_GROWING	1	// DECLARE_*PTR_VECTOR()
+#define PTR_LIST_IR		2	// DECLARE_IR_PTR_*()
+#define PTR_LIST_KIND(head)						\
+	((sizeof((head)->vector_type) ? PTR_LIST_GROWING : 0) |		\
+	 (sizeof((head)->ir_type) ? PTR_LIST_IR : 0))
+// the number of entries of the biggest nodes
+#define PTR_LIST_MAX_NODE_NR	(LIST_NODE_NR +				\
+	((sizeof(struct ptr_list) << PTR_LIST_MAX_ORDER) - sizeof(struct ptr_list)) / sizeof(void *))
+
 
 void * undo_ptr_list_last(struct ptr_list **head);
 void * delete_ptr_list_last(struct ptr_list **head);
@@ -47,6 +103,14 @@ extern void *last_ptr_list(struct ptr_list *);
 extern void *ptr_list_nth_entry(struct ptr_list *, unsigned int idx);
 extern void pack_ptr_list(struct ptr_list **);
 
+// the allocators of the nodes of the IR lists, and of the big nodes
+// of the other vector lists
+struct allocator_stats;
+extern void mark_ir_ptrlists(void);
+extern void release_ir_ptrlists(void);
+extern void get_ir_ptrlist_stats(struct allocator_stats *);
+extern void get_ptrvec_stats(struct allocator_stats *);
+
 /*
  * Hey, who said that you can't do overloading in C?
  *
@@ -55,16 +119,23 @@ extern void pack_ptr_list(struct ptr_list **);
  */
 extern void **__add_ptr_list(struct ptr_list **, void *);
 extern void **__add_ptr_list_tag(struct ptr_list **, void *, unsigned long);
+extern void **__add_ptr_list_kind(struct ptr_list **, void *, int);
 
 #define add_ptr_list(list, ptr) ({					\
 		struct ptr_list** head = (struct ptr_list**)(list);	\
+		int kind = PTR_LIST_KIND(*(list));			\
 		CHECK_TYPE(*(list),ptr);				\
-		(__typeof__(&(ptr))) __add_ptr_list(head, ptr);		\
+		(__typeof__(&(ptr))) (kind ?				\
+			__add_ptr_list_kind(head, ptr, kind) :		\
+			__add_ptr_list(head, ptr));			\
 	})
 #define add_ptr_list_tag(list, ptr, tag) ({				\
 		struct ptr_list** head = (struct ptr_list**)(list);	\
+		int kind = PTR_LIST_KIND(*(list));			\
 		CHECK_TYPE(*(list),ptr);				\
-		(__typeof__(&(ptr))) __add_ptr_list_tag(head, ptr, tag);\
+		(__typeof__(&(ptr))) (kind ?				\
+			__add_ptr_list_kind(head, tag_ptr(ptr, tag), kind) :\
+			__add_ptr_list_tag(head, ptr, tag));		\
 	})
 
 #define pop_ptr_list(l) ({						\
@@ -167,11 +238,12 @@ extern void __free_ptr_list(struct ptr_list **);
 		if (__nr < __list->nr) {				\
 			ptr = PTR_ENTRY(__list,__nr);			\
 			__nr++;						\
-			break;						\
+			if (ptr || !__list->rm)				\
+				break;					\
 		}							\
 		ptr = NULL;						\
-		__nr = 0;						\
-	} while ((__list = __list->next) != __head)			\
+	} while (__nr < __list->nr ||					\
+		 (__nr = 0, (__list = __list->next) != __head))		\
 
 #define DO_PREPARE(head, ptr, __head, __list, __nr, PTR_ENTRY)		\
 	do {								\
@@ -255,6 +327,8 @@ extern void __free_ptr_list(struct ptr_list **);
 	__inside##new:							\
 		while (--__newnr >= 0) {				\
 			new = PTR_ENTRY(__newlist,__newnr);		\
+			if (__newlist->rm && !new)			\
+				continue;				\
 
 #define DO_THIS_ADDRESS(ptr, __head, __list, __nr)			\
 	(&__list->list[__nr])
@@ -264,7 +338,7 @@ extern void split_ptr_list_head(struct ptr_list *);
 
 #define DO_INSERT_CURRENT(new, __head, __list, __nr) do {		\
 	PTRLIST_TYPE(__head) *__this, *__last;				\
-	if (__list->nr == LIST_NODE_NR) {				\
+	if (__list->nr == PTR_LIST_NODE_NR(__list)) {			\
 		split_ptr_list_head((struct ptr_list*)__list);		\
 		if (__nr >= __list->nr) {				\
 			__nr -= __list->nr;				\
@@ -284,6 +358,12 @@ extern void split_ptr_list_head(struct ptr_list *);
 #define DO_DELETE_CURRENT(__head, __list, __nr) do {			\
 	PTRLIST_TYPE(__head) *__this = __list->list + __nr;		\
 	PTRLIST_TYPE(__head) *__last = __list->list + __list->nr - 1;	\
+	if (__list->order) {						\
+		/* don't shift the entries of the big nodes */		\
+		*__this = NULL;						\
+		__list->rm++;						\
+		break;							\
+	}								\
 	while (__this < __last) {					\
 		__this[0] = __this[1];					\
 		__this++;						\
@@ -25,24 +25,151 @@
 
 #include "ptrmap.h"
 #include "allocate.h"
+#include "lib.h"
 #include <stddef.h>
+#include <stdlib.h>
 
 #define	MAP_NR	7
 
+///
+// The maps start as a chain of small blocks searched linearly.
+// Once the two first blocks are full, the map is turned into an
+// open-addressing hash table: the head block then only holds the
+// table, which doubles in size each time it's 3/4 full.
+// The tables too big for an allocation chunk are malloc'ed, see
+// alloc_table().
+#define	MAP_HASHED	-1
+#define	MAP_HASH_MIN	32
+#define	MAP_HASH_MAX	1024
+
 struct ptrpair {
 	void *key;
 	void *val;
 };
 struct ptrmap {
 	struct ptrmap *next;
-	int nr;
-	struct ptrpair pairs[MAP_NR];
+	int nr;			// the number of pairs or MAP_HASHED
+	int ir;			// allocated in the IR arenas
+	union {
+		struct ptrpair pairs[MAP_NR];
+		struct {
+			unsigned int size;	// the number of slots, a power of 2
+			unsigned int count;
+			struct ptrpair *table;
+		};
+	};
 };
 
 DECLARE_ALLOCATOR(ptrmap);
 ALLOCATOR(ptrmap, "ptrmap");
 
-void __ptrmap_add(struct ptrmap **mapp, void *key, void *val)
+// the tables of the hashed maps
+__DECLARE_ALLOCATOR(struct ptrpair, ptrmap_hash);
+__ALLOCATOR(struct ptrpair, "ptrmap hash", ptrmap_hash);
+
+// the same for the IR maps, released by release_ir_allocations()
+__DECLARE_ALLOCATOR(struct ptrmap, ir_ptrmap);
+__ALLOCATOR(struct ptrmap, "ir ptrmap", ir_ptrmap);
+__DECLARE_ALLOCATOR(struct ptrpair, ir_ptrmap_hash);
+__ALLOCATOR(struct ptrpair, "ir ptrmap hash", ir_ptrmap_hash);
+
+static struct ptrmap *alloc_block(int ir)
+{
+	struct ptrmap *map;
+
+	map = ir ? __alloc_ir_ptrmap(0) : __alloc_ptrmap(0);
+	map->ir = ir;
+	return map;
+}
+
+static void free_block(struct ptrmap *map)
+{
+	if (map->ir)
+		__free_ir_ptrmap(map);
+	else
+		__free_ptrmap(map);
+}
+
+// The tables of more than MAP_HASH_MAX slots. They belong to a single
+// map and are freed when it outgrows them. Those of the IR maps which
+// are allocated in an arena are also chained to be freed with it.
+struct big_table {
+	struct big_table *next;
+	struct big_table **pprev;
+	struct ptrpair pairs[];
+};
+
+static struct big_table *ir_tables;
+static unsigned int big_allocations;
+static unsigned long big_bytes;
+
+static struct ptrpair *alloc_table(struct ptrmap *map, unsigned int size)
+{
+	int extra = (size - 1) * sizeof(struct ptrpair);
+	struct big_table *big;
+
+	if (size <= MAP_HASH_MAX) {
+		if (map->ir)
+			return __alloc_ir_ptrmap_hash(extra);
+		return __alloc_ptrmap_hash(extra);
+	}
+
+	big = calloc(1, sizeof(*big) + size * sizeof(struct ptrpair));
+	if (!big)
+		die("out of memory");
+	big_allocations++;
+	big_bytes += size * sizeof(struct ptrpair);
+	if (map->ir && ir_ptrmap_hash_allocator.mark.active) {
+		big->next = ir_tables;
+		if (ir_tables)
+			ir_tables->pprev = &big->next;
+		big->pprev = &ir_tables;
+		ir_tables = big;
+	}
+	return big->pairs;
+}
+
+static void free_big_table(struct big_table *big)
+{
+	if (big->pprev) {
+		*big->pprev = big->next;
+		if (big->next)
+			big->next->pprev = big->pprev;
+	}
+	free(big);
+}
+
+static void free_table(struct ptrpair *table, unsigned int size)
+{
+	// the small ones are left to the allocator, like the rest of the IR
+	if (size <= MAP_HASH_MAX)
+		return;
+	free_big_table((void *)((char *)table - offsetof(struct big_table, pairs)));
+}
+
+void mark_ir_ptrmaps(void)
+{
+	mark_ir_ptrmap_alloc();
+	mark_ir_ptrmap_hash_alloc();
+}
+
+void release_ir_ptrmaps(void)
+{
+	while (ir_tables)
+		free_big_table(ir_tables);
+	release_ir_ptrmap_alloc();
+	release_ir_ptrmap_hash_alloc();
+}
+
+void get_ptrmap_table_stats(struct allocator_stats *s)
+{
+	s->name = "ptrmap tables";
+	s->allocations = big_allocations;
+	s->useful_bytes = big_bytes;
+	s->total_bytes = big_bytes;
+}
+
+static void linear_add(struct ptrmap **mapp, void *key, void *val, int ir)
 {
 	struct ptrmap *head = *mapp;
 	struct ptrmap *newmap;
@@ -59,7 +186,7 @@ void __ptrmap_add(struct ptrmap **mapp, void *key, void *val)
 	}
 
 	// need a new block
-	newmap = __alloc_ptrmap(0);
+	newmap = alloc_block(ir);
 	if (!head) {
 		*mapp = newmap;
 	} else {
@@ -76,34 +203,245 @@ oldmap:
 	map->nr = ++nr;
 }
 
-void *__ptrmap_lookup(struct ptrmap *map, void *key)
+static struct ptrpair *linear_lookup(struct ptrmap *map, void *key)
 {
 	for (; map; map = map->next) {
 		int i, n = map->nr;
 		for (i = 0; i < n; i++) {
 			struct ptrpair *pair = &map->pairs[i];
 			if (pair->key == key)
-				return pair->val;
+				return pair;
 		}
 	}
 	return NULL;
 }
 
-void __ptrmap_update(struct ptrmap **mapp, void *key, void *val)
+static void *linear_delete(struct ptrmap **mapp, void *key)
 {
-	struct ptrmap *map = *mapp;
+	struct ptrmap *head = *mapp;
+	struct ptrmap *last, *map;
+	struct ptrpair *pair;
+	void *val;
 
-	for (; map; map = map->next) {
-		int i, n = map->nr;
-		for (i = 0; i < n; i++) {
-			struct ptrpair *pair = &map->pairs[i];
-			if (pair->key == key) {
-				if (pair->val != val)
-					pair->val = val;
-				return;
+	pair = linear_lookup(head, key);
+	if (!pair)
+		return NULL;
+	val = pair->val;
+
+	// the last pair of the last block takes its place
+	last = head->next ? head->next : head;
+	*pair = last->pairs[--last->nr];
+	last->pairs[last->nr].key = NULL;
+	last->pairs[last->nr].val = NULL;
+	if (last->nr)
+		return val;
+	map = last->next;
+	if (last == head)
+		*mapp = NULL;
+	else
+		head->next = map;
+	free_block(last);
+	return val;
+}
+
+static inline unsigned int hash_slot(struct ptrmap *map, void *key)
+{
+	unsigned long long hash = (unsigned long)key;
+
+	return (hash * 0x9E3779B97F4A7C15ULL) >> (64 - __builtin_ctz(map->size));
+}
+
+// the slot holding @key or the empty one where it should go
+static struct ptrpair *hash_find(struct ptrmap *map, void *key)
+{
+	unsigned int mask = map->size - 1;
+	unsigned int slot = hash_slot(map, key);
+	struct ptrpair *pair;
+
+	while ((pair = &map->table[slot])->key) {
+		if (pair->key == key)
+			break;
+		slot = (slot + 1) & mask;
+	}
+	return pair;
+}
+
+static void hash_resize(struct ptrmap *map, unsigned int size)
+{
+	struct ptrpair *old = map->table;
+	unsigned int i, n = map->size;
+
+	map->table = alloc_table(map, size);
+	map->size = size;
+	for (i = 0; i < n; i++) {
+		if (old[i].key)
+			*hash_find(map, old[i].key) = old[i];
+	}
+	if (old)
+		free_table(old, n);
+}
+
+static void hash_add(struct ptrmap *map, void *key, void *val)
+{
+	struct ptrpair *pair;
+
+	if (map->count * 4 >= map->size * 3)
+		hash_resize(map, map->size * 2);
+	pair = hash_find(map, key);
+	if (!pair->key)
+		map->count++;
+	pair->key = key;
+	pair->val = val;
+}
+
+static void hash_delete(struct ptrmap *map, struct ptrpair *pair)
+{
+	unsigned int mask = map->size - 1;
+	unsigned int hole = pair - map->table;
+	unsigned int slot = hole;
+
+	// move back the following pairs which can fill the hole
+	for (;;) {
+		struct ptrpair *next;
+		unsigned int home;
+
+		slot = (slot + 1) & mask;
+		next = &map->table[slot];
+		if (!next->key)
+			break;
+		home = hash_slot(map, next->key);
+		if (((slot - home) & mask) < ((slot - hole) & mask))
+			continue;
+		map->table[hole] = *next;
+		hole = slot;
+	}
+	map->table[hole].key = NULL;
+	map->table[hole].val = NULL;
+	map->count--;
+}
+
+// turn a map made of two full blocks into a hashed one
+static void hash_convert(struct ptrmap *head)
+{
+	struct ptrmap *next = head->next;
+	struct ptrpair pairs[2 * MAP_NR];
+	int i;
+
+	for (i = 0; i < MAP_NR; i++) {
+		pairs[i] = head->pairs[i];
+		pairs[MAP_NR + i] = next->pairs[i];
+	}
+	free_block(next);
+
+	head->next = NULL;
+	head->nr = MAP_HASHED;
+	head->size = 0;
+	head->count = 0;
+	hash_resize(head, MAP_HASH_MIN);
+	for (i = 0; i < 2 * MAP_NR; i++)
+		hash_add(head, pairs[i].key, pairs[i].val);
+}
+
+static struct ptrpair *lookup_pair(struct ptrmap *map, void *key)
+{
+	if (map && map->nr == MAP_HASHED) {
+		struct ptrpair *pair = hash_find(map, key);
+		return pair->key ? pair : NULL;
+	}
+	return linear_lookup(map, key);
+}
+
+void __ptrmap_add(struct ptrmap **mapp, void *key, void *val, int ir)
+{
+	struct ptrmap *head = *mapp;
+
+	if (head && head->nr != MAP_HASHED) {
+		struct ptrmap *next = head->next;
+		if (next && next->nr == MAP_NR)
+			hash_convert(head);
+	}
+	if (head && head->nr == MAP_HASHED)
+		hash_add(head, key, val);
+	else
+		linear_add(mapp, key, val, ir);
+}
+
+void *__ptrmap_lookup(struct ptrmap *map, void *key)
+{
+	struct ptrpair *pair = lookup_pair(map, key);
+
+	return pair ? pair->val : NULL;
+}
+
+void __ptrmap_update(struct ptrmap **mapp, void *key, void *val, int ir)
+{
+	struct ptrpair *pair = lookup_pair(*mapp, key);
+
+	if (pair) {
+		if (pair->val != val)
+			pair->val = val;
+		return;
+	}
+
+	__ptrmap_add(mapp, key, val, ir);
+}
+
+///
+// remove a key from a map
+// @return: the value associated to @key or NULL if it wasn't present
+void *__ptrmap_delete(struct ptrmap **mapp, void *key)
+{
+	struct ptrmap *head = *mapp;
+
+	if (head && head->nr == MAP_HASHED) {
+		struct ptrpair *pair = hash_find(head, key);
+		void *val;
+
+		if (!pair->key)
+			return NULL;
+		val = pair->val;
+		hash_delete(head, pair);
+		return val;
+	}
+	return linear_delete(mapp, key);
+}
+
+///
+// walk a map
+// @iter: the state of the walk, zeroed before the first call
+// @return: 0 once all the pairs have been given, 1 otherwise.
+//
+// The map must not be changed during the walk.
+int __ptrmap_next(struct ptrmap *map, struct ptrmap_iter *iter, void **key, void **val)
+{
+	struct ptrpair *pair;
+
+	if (!iter->started) {
+		iter->started = 1;
+		iter->block = map;
+		iter->idx = 0;
+	}
+	for (map = iter->block; map; map = map->next, iter->idx = 0) {
+		while (1) {
+			int idx = iter->idx++;
+
+			if (map->nr == MAP_HASHED) {
+				if (idx >= map->size)
+					break;
+				pair = &map->table[idx];
+				if (!pair->key)
+					continue;
+			} else {
+				if (idx >= map->nr)
+					break;
+				pair = &map->pairs[idx];
 			}
+			iter->block = map;
+			*key = pair->key;
+			*val = pair->val;
+			return 1;
 		}
 	}
-
-	__ptrmap_add(mapp, key, val);
+	iter->block = NULL;
+	return 0;
 }
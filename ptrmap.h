@@ -3,26 +3,66 @@
 
 struct ptrmap;
 
-#define DECLARE_PTRMAP(name, ktype, vtype)				\
+// the state of a walk over a map, zero-initialized at the start
+struct ptrmap_iter {
+	struct ptrmap *block;
+	int idx;
+	int started;
+};
+
+#define __DECLARE_PTRMAP(name, ktype, vtype, ir)			\
 	struct name ## _pair { ktype key; vtype val; };			\
 	struct name { struct name ## _pair block[1]; };			\
 	static inline							\
 	void name##_add(struct name **map, ktype k, vtype v) {		\
-		__ptrmap_add((struct ptrmap**)map, k, v);		\
+		__ptrmap_add((struct ptrmap**)map, k, v, ir);		\
 	}								\
 	static inline							\
 	void name##_update(struct name **map, ktype k, vtype v) {	\
-		__ptrmap_update((struct ptrmap**)map, k, v);		\
+		__ptrmap_update((struct ptrmap**)map, k, v, ir);	\
 	}								\
 	static inline							\
 	vtype name##_lookup(struct name *map, ktype k) {		\
 		vtype val = __ptrmap_lookup((struct ptrmap*)map, k);	\
 		return val;						\
 	}								\
+	static inline							\
+	vtype name##_delete(struct name **map, ktype k) {		\
+		vtype val = __ptrmap_delete((struct ptrmap**)map, k);	\
+		return val;						\
+	}								\
+	static inline							\
+	int name##_next(struct name *map, struct ptrmap_iter *iter,	\
+			ktype *k, vtype *v) {				\
+		void *key, *val;					\
+		if (!__ptrmap_next((struct ptrmap*)map, iter, &key, &val))\
+			return 0;					\
+		*k = key;						\
+		*v = val;						\
+		return 1;						\
+	}
+
+#define DECLARE_PTRMAP(name, ktype, vtype)				\
+	__DECLARE_PTRMAP(name, ktype, vtype, 0)
+
+// the maps of the IR of the current function: their blocks are
+// allocated in the IR arenas (see mark_ir_allocations()) and so must
+// not be kept past the function
+#define DECLARE_IR_PTRMAP(name, ktype, vtype)				\
+	__DECLARE_PTRMAP(name, ktype, vtype, 1)
 
 /* ptrmap.c */
-void __ptrmap_add(struct ptrmap **mapp, void *key, void *val);
-void __ptrmap_update(struct ptrmap **mapp, void *key, void *val);
+void __ptrmap_add(struct ptrmap **mapp, void *key, void *val, int ir);
+void __ptrmap_update(struct ptrmap **mapp, void *key, void *val, int ir);
 void *__ptrmap_lookup(struct ptrmap *map, void *key);
+void *__ptrmap_delete(struct ptrmap **mapp, void *key);
+int __ptrmap_next(struct ptrmap *map, struct ptrmap_iter *iter, void **key, void **val);
+
+// the arenas of the IR maps, see mark_ir_allocations()
+void mark_ir_ptrmaps(void);
+void release_ir_ptrmaps(void);
+
+struct allocator_stats;
+void get_ptrmap_table_stats(struct allocator_stats *);
 
 #endif
@@ -0,0 +1,395 @@
+// SPDX-License-Identifier: MIT
+//
+// Sparse conditional constant propagation
+//
+
+///
+// Sparse conditional constant propagation
+// ---------------------------------------
+//
+// This is the classic algorithm from Wegman & Zadeck: the values are
+// propagated along the SSA def-use chains while only the CFG edges
+// which can be taken are followed. So, the constants are propagated
+// through the phi-nodes and the branches which can't be taken are
+// removed, all in a single pass.
+//
+// The lattice value of each pseudo is kept in its ``->priv``:
+//	* NULL: not yet known (top)
+//	* a PSEUDO_VAL: known to be this constant
+//	* VOID: not a constant (bottom)
+
+#include "sccp.h"
+#include "flowgraph.h"
+#include "linearize.h"
+#include "simplify.h"
+#include "flow.h"
+#include "ptrmap.h"
+#include "lib.h"
+
+#define	OVERDEFINED	VOID
+
+DECLARE_IR_PTRMAP(edge_map, struct basic_block *, struct basic_block *);
+
+struct sccp_bb {
+	int executable;
+	struct edge_map *edges;		// the parents of the taken edges
+};
+
+static struct sccp_bb *blocks;
+static struct basic_block_list *bb_worklist;
+static struct instruction_list *worklist;
+
+static inline struct sccp_bb *sccp_bb(struct basic_block *bb)
+{
+	return &blocks[bb->postorder_nr];
+}
+
+// the pseudo defined by the instruction, if it can hold a value
+static pseudo_t insn_target(struct instruction *insn)
+{
+	if (!(opcode_table[insn->opcode].flags & OPF_TARGET))
+		return NULL;
+	if (insn->target->type != PSEUDO_REG)
+		return NULL;
+	return insn->target;
+}
+
+static pseudo_t lattice(pseudo_t p)
+{
+	switch (p->type) {
+	case PSEUDO_VAL:
+		return p;
+	case PSEUDO_REG:
+		return p->priv;
+	default:
+		return OVERDEFINED;
+	}
+}
+
+static pseudo_t meet(pseudo_t a, pseudo_t b)
+{
+	if (!a)
+		return b;
+	if (!b || a == b)
+		return a;
+	return OVERDEFINED;
+}
+
+static void queue(struct instruction *insn)
+{
+	// phi-nodes look through their phi-sources
+	if (insn->opcode == OP_PHISOURCE) {
+		struct pseudo_user *pu;
+
+		FOR_EACH_PTR(insn->target->users, pu) {
+			queue(pu->insn);
+		} END_FOR_EACH_PTR(pu);
+		return;
+	}
+	if (insn->queued)
+		return;
+	insn->queued = 1;
+	add_instruction(&worklist, insn);
+}
+
+static void set_value(pseudo_t target, pseudo_t val)
+{
+	pseudo_t old = target->priv;
+	struct pseudo_user *pu;
+
+	if (!val || val == old || old == OVERDEFINED)
+		return;
+	if (old)
+		val = OVERDEFINED;	// the values can only go down
+	target->priv = val;
+
+	FOR_EACH_PTR(target->users, pu) {
+		queue(pu->insn);
+	} END_FOR_EACH_PTR(pu);
+}
+
+static void mark_edge(struct basic_block *from, struct basic_block *to)
+{
+	struct sccp_bb *b = sccp_bb(to);
+	struct instruction *insn;
+
+	if (edge_map_lookup(b->edges, from))
+		return;
+	edge_map_add(&b->edges, from, from);
+	if (!b->executable) {
+		b->executable = 1;
+		add_bb(&bb_worklist, to);
+		return;
+	}
+
+	// a new incoming edge: the phi-nodes must be reevaluated
+	FOR_EACH_PTR(to->insns, insn) {
+		if (!insn->bb)
+			continue;
+		if (insn->opcode != OP_PHI)
+			break;
+		queue(insn);
+	} END_FOR_EACH_PTR(insn);
+}
+
+static struct multijmp *switch_target(struct instruction *insn, long long val)
+{
+	struct multijmp *jmp;
+
+	FOR_EACH_PTR(insn->multijmp_list, jmp) {
+		/* Default case */
+		if (jmp->begin > jmp->end)
+			return jmp;
+		if (val >= jmp->begin && val <= jmp->end)
+			return jmp;
+	} END_FOR_EACH_PTR(jmp);
+	return NULL;
+}
+
+static void mark_all_targets(struct instruction *insn)
+{
+	struct multijmp *jmp;
+
+	FOR_EACH_PTR(insn->multijmp_list, jmp) {
+		mark_edge(insn->bb, jmp->target);
+	} END_FOR_EACH_PTR(jmp);
+}
+
+///
+// is the phi-source's value flowing into the phi-node?
+static bool live_phisrc(struct instruction *phi, struct instruction *phisrc)
+{
+	struct basic_block *src = phisrc->bb;
+
+	if (!src || !sccp_bb(src)->executable)
+		return false;
+	if (edge_map_lookup(sccp_bb(phi->bb)->edges, src))
+		return true;
+	// not coming directly from a parent: only the block matters
+	return !lookup_bb(src->children, phi->bb);
+}
+
+static pseudo_t eval_phi(struct instruction *insn)
+{
+	pseudo_t val = NULL;
+	pseudo_t phi;
+
+	FOR_EACH_PTR(insn->phi_list, phi) {
+		struct instruction *def;
+
+		if (phi == VOID)
+			continue;
+		if (phi->type != PSEUDO_PHI)
+			return OVERDEFINED;
+		def = phi->def;
+		if (!live_phisrc(insn, def))
+			continue;
+		val = meet(val, lattice(def->phi_src));
+		if (val == OVERDEFINED)
+			break;
+	} END_FOR_EACH_PTR(phi);
+	return val;
+}
+
+static pseudo_t eval_sel(struct instruction *insn)
+{
+	pseudo_t cond = lattice(insn->src1);
+
+	if (!cond)
+		return NULL;
+	if (cond == OVERDEFINED)
+		return meet(lattice(insn->src2), lattice(insn->src3));
+	return lattice(cond->value ? insn->src2 : insn->src3);
+}
+
+static pseudo_t eval_binop(struct instruction *insn)
+{
+	pseudo_t src1 = lattice(insn->src1);
+	pseudo_t src2 = lattice(insn->src2);
+
+	if (src1 == OVERDEFINED || src2 == OVERDEFINED)
+		return OVERDEFINED;
+	if (!src1 || !src2)
+		return NULL;
+	return eval_constant(insn, src1, src2) ?: OVERDEFINED;
+}
+
+static pseudo_t eval_unop(struct instruction *insn)
+{
+	pseudo_t src = lattice(insn->src);
+
+	if (!src || src == OVERDEFINED)
+		return src;
+	return eval_constant(insn, src, NULL) ?: OVERDEFINED;
+}
+
+static void visit_branch(struct instruction *insn)
+{
+	pseudo_t cond = lattice(insn->cond);
+	struct multijmp *jmp;
+
+	if (!cond)
+		return;
+	switch (insn->opcode) {
+	case OP_CBR:
+		if (cond == OVERDEFINED || cond->value)
+			mark_edge(insn->bb, insn->bb_true);
+		if (cond == OVERDEFINED || !cond->value)
+			mark_edge(insn->bb, insn->bb_false);
+		break;
+	case OP_SWITCH:
+		if (cond != OVERDEFINED && (jmp = switch_target(insn, cond->value)))
+			mark_edge(insn->bb, jmp->target);
+		else
+			mark_all_targets(insn);
+		break;
+	}
+}
+
+static void visit_insn(struct instruction *insn)
+{
+	pseudo_t target;
+	pseudo_t val;
+
+	switch (insn->opcode) {
+	case OP_BR:
+		mark_edge(insn->bb, insn->bb_true);
+		return;
+	case OP_CBR:
+	case OP_SWITCH:
+		visit_branch(insn);
+		return;
+	case OP_COMPUTEDGOTO:
+		mark_all_targets(insn);
+		return;
+	case OP_PHI:
+		val = eval_phi(insn);
+		break;
+	case OP_SEL:
+		val = eval_sel(insn);
+		break;
+	case OP_BINARY ... OP_BINARY_END:
+	case OP_BINCMP ... OP_BINCMP_END:
+		val = eval_binop(insn);
+		break;
+	case OP_UNOP ... OP_UNOP_END:
+		val = eval_unop(insn);
+		break;
+	default:
+		val = OVERDEFINED;
+		break;
+	}
+	if ((target = insn_target(insn)))
+		set_value(target, val);
+}
+
+static void propagate(void)
+{
+	while (bb_worklist || worklist) {
+		struct basic_block_list *bbs = bb_worklist;
+		struct instruction_list *list;
+		struct basic_block *bb;
+		struct instruction *insn;
+
+		bb_worklist = NULL;
+		FOR_EACH_PTR(bbs, bb) {
+			FOR_EACH_PTR(bb->insns, insn) {
+				if (insn->bb)
+					visit_insn(insn);
+			} END_FOR_EACH_PTR(insn);
+		} END_FOR_EACH_PTR(bb);
+		free_ptr_list(&bbs);
+
+		list = worklist;
+		worklist = NULL;
+		FOR_EACH_PTR(list, insn) {
+			insn->queued = 0;
+			if (insn->bb && sccp_bb(insn->bb)->executable)
+				visit_insn(insn);
+		} END_FOR_EACH_PTR(insn);
+		free_ptr_list(&list);
+	}
+}
+
+///
+// replace the constant values and the branches which can't be taken
+static int rewrite_insn(struct instruction *insn)
+{
+	struct basic_block *target;
+	struct multijmp *jmp;
+	pseudo_t val;
+
+	switch (insn->opcode) {
+	case OP_CBR:
+		if (insn->bb_true == insn->bb_false)
+			return 0;
+		val = lattice(insn->cond);
+		if (!val || val == OVERDEFINED)
+			return 0;
+		target = val->value ? insn->bb_true : insn->bb_false;
+		return convert_to_jump(insn, target);
+	case OP_SWITCH:
+		val = lattice(insn->cond);
+		if (!val || val == OVERDEFINED)
+			return 0;
+		if (!(jmp = switch_target(insn, val->value)))
+			return 0;
+		return convert_to_jump(insn, jmp->target);
+	}
+
+	if (!insn_target(insn))
+		return 0;
+	val = insn->target->priv;
+	if (!val || val == OVERDEFINED)
+		return 0;
+	return replace_with_pseudo(insn, val);
+}
+
+int sccp(struct entrypoint *ep)
+{
+	struct basic_block *entry = ep->entry->bb;
+	struct basic_block *bb;
+	unsigned int size = 0;
+	int changed = 0;
+
+	// the postorder is up-to-date
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *insn;
+
+		size++;
+		FOR_EACH_PTR(bb->insns, insn) {
+			if (insn_target(insn))
+				insn->target->priv = NULL;
+		} END_FOR_EACH_PTR(insn);
+	} END_FOR_EACH_PTR(bb);
+	blocks = calloc(size, sizeof(*blocks));
+
+	sccp_bb(entry)->executable = 1;
+	add_bb(&bb_worklist, entry);
+	propagate();
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct sccp_bb *b = sccp_bb(bb);
+		struct instruction *insn;
+
+		if (!b->executable)
+			continue;
+		FOR_EACH_PTR(bb->insns, insn) {
+			if (insn->bb)
+				changed |= rewrite_insn(insn);
+		} END_FOR_EACH_PTR(insn);
+	} END_FOR_EACH_PTR(bb);
+
+	// the remaining values are not needed anymore
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *insn;
+
+		FOR_EACH_PTR(bb->insns, insn) {
+			if (insn_target(insn))
+				insn->target->priv = NULL;
+		} END_FOR_EACH_PTR(insn);
+	} END_FOR_EACH_PTR(bb);
+
+	free(blocks);
+	return changed;
+}
@@ -0,0 +1,8 @@
+#ifndef SCCP_H
+#define SCCP_H
+
+struct entrypoint;
+
+int sccp(struct entrypoint *ep);
+
+#endif
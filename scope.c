@@ -99,8 +99,10 @@ void start_function_scope(void)
 
 static void remove_symbol_scope(struct symbol *sym)
 {
-	struct symbol **ptr = &sym->ident->symbols;
+	struct ident *ident = sym->ident;
+	struct symbol **ptr = ident_bindings(ident, sym->namespace);
 
+	// scopes are nested, so it's nearly always the first one
 	while (*ptr != sym)
 		ptr = &(*ptr)->next_id;
 	*ptr = sym->next_id;
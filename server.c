@@ -0,0 +1,462 @@
+// SPDX-License-Identifier: MIT
+//
+// Resident checker: 'sparse --server=PATH' and its client.
+//
+// The server does the initialization once (types, predefined macros,
+// builtins, ...) and then waits for requests on a UNIX socket. Each
+// request is checked in a child process, forked from the initialized
+// server, which then continues like a normal sparse run.
+//
+// A request is made of the client's stdin, stdout & stderr, which are
+// passed with the request and used directly by the child, its current
+// directory, its arguments and its environment. The reply is the child's
+// wait status or SERVER_RETRY if the request needs another initialization
+// than the server's one (see sparse_request()), the client then doing
+// the check itself.
+//
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "lib.h"
+
+#define SERVER_MAGIC	0x52535053	// "SPSR"
+#define SERVER_RETRY	(-1)
+#define SERVER_EXIT_RETRY	125	// the child's exit code for SERVER_RETRY
+#define REQUEST_MAX	(1 << 20)
+
+struct request_header {
+	uint32_t magic;
+	uint32_t size;		// of the strings following the header
+	uint32_t argc;
+	uint32_t envc;		// the strings: cwd, the arguments & the environment
+};
+
+struct worker {
+	pid_t pid;
+	int fd;
+};
+
+static struct worker *workers;
+static int workers_nr;
+static int sigchld_pipe[2];
+static volatile sig_atomic_t server_stop;
+
+static int read_all(int fd, void *buf, size_t size)
+{
+	char *p = buf;
+
+	while (size) {
+		ssize_t n = read(fd, p, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t size)
+{
+	const char *p = buf;
+
+	while (size) {
+		ssize_t n = write(fd, p, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static int server_address(struct sockaddr_un *addr, const char *path)
+{
+	if (strlen(path) >= sizeof(addr->sun_path))
+		return -1;
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+static int server_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (server_address(&addr, path) < 0)
+		return -1;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The client side
+
+static int send_request(int fd, int argc, char **argv, const char *cwd)
+{
+	extern char **environ;
+	struct request_header hdr = { .magic = SERVER_MAGIC, .argc = argc };
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+	} cmsg;
+	struct msghdr msg = { 0 };
+	struct iovec iov;
+	char *buf, *p;
+	size_t size;
+	int i;
+
+	size = strlen(cwd) + 1;
+	for (i = 0; i < argc; i++)
+		size += strlen(argv[i]) + 1;
+	for (i = 0; environ[i]; i++)
+		size += strlen(environ[i]) + 1;
+	if (size > REQUEST_MAX)
+		return -1;
+	hdr.size = size;
+	hdr.envc = i;
+
+	p = buf = malloc(size);
+	if (!buf)
+		return -1;
+	p = stpcpy(p, cwd) + 1;
+	for (i = 0; i < argc; i++)
+		p = stpcpy(p, argv[i]) + 1;
+	for (i = 0; environ[i]; i++)
+		p = stpcpy(p, environ[i]) + 1;
+
+	// the header goes with our stdin, stdout & stderr
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof(hdr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsg.buf;
+	msg.msg_controllen = sizeof(cmsg.buf);
+	cmsg.hdr.cmsg_level = SOL_SOCKET;
+	cmsg.hdr.cmsg_type = SCM_RIGHTS;
+	cmsg.hdr.cmsg_len = CMSG_LEN(3 * sizeof(int));
+	for (i = 0; i < 3; i++)
+		((int *)CMSG_DATA(&cmsg.hdr))[i] = i;
+
+	if (sendmsg(fd, &msg, 0) != sizeof(hdr) || write_all(fd, buf, size) < 0) {
+		free(buf);
+		return -1;
+	}
+	free(buf);
+	return 0;
+}
+
+//
+// Check the files via the server given with '--client=PATH', if any.
+// Return the exit status for the check or -1 if it must be done locally,
+// in which case the '--client' option has been removed from argv.
+//
+int sparse_client(int argc, char **argv)
+{
+	const char *path = NULL;
+	char cwd[PATH_MAX];
+	int32_t status;
+	int i, fd;
+
+	for (i = 1; i < argc; i++) {
+		if (!strncmp(argv[i], "--client=", 9)) {
+			path = argv[i] + 9;
+			memmove(&argv[i], &argv[i + 1], (argc - i) * sizeof(*argv));
+			argc--;
+			break;
+		}
+	}
+	if (!path || !getcwd(cwd, sizeof(cwd)))
+		return -1;
+
+	fd = server_connect(path);
+	if (fd < 0)
+		return -1;
+	fflush(stdout);
+	fflush(stderr);
+	if (send_request(fd, argc, argv, cwd) < 0 || read_all(fd, &status, sizeof(status)) < 0)
+		status = SERVER_RETRY;
+	close(fd);
+
+	if (status == SERVER_RETRY)
+		return -1;
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+	if (WIFSIGNALED(status))
+		fprintf(stderr, "sparse: the check was aborted (signal %d)\n", WTERMSIG(status));
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The server side
+
+static int read_request(int fd, int fds[3], char **bufp, struct request_header *hdr)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+	} cmsg;
+	struct msghdr msg = { 0 };
+	struct cmsghdr *c;
+	struct iovec iov;
+	char *buf;
+
+	iov.iov_base = hdr;
+	iov.iov_len = sizeof(*hdr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsg.buf;
+	msg.msg_controllen = sizeof(cmsg.buf);
+	if (recvmsg(fd, &msg, 0) != sizeof(*hdr))
+		return -1;
+	c = CMSG_FIRSTHDR(&msg);
+	if (!c || c->cmsg_type != SCM_RIGHTS || c->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+		return -1;
+	memcpy(fds, CMSG_DATA(c), 3 * sizeof(int));
+
+	if (hdr->magic != SERVER_MAGIC || hdr->size > REQUEST_MAX || !hdr->argc)
+		goto bad;
+	buf = malloc(hdr->size + 1);
+	if (!buf)
+		goto bad;
+	if (read_all(fd, buf, hdr->size) < 0) {
+		free(buf);
+		goto bad;
+	}
+	buf[hdr->size] = '\0';
+	*bufp = buf;
+	return 0;
+
+bad:
+	close(fds[0]);
+	close(fds[1]);
+	close(fds[2]);
+	return -1;
+}
+
+//
+// In the child: take the client's place and return the initial
+// symbol list for the request's files.
+//
+static struct symbol_list *start_request(int fd, int fds[3], char *buf, struct request_header *hdr, struct string_list **filelist)
+{
+	struct symbol_list *list;
+	char *end = buf + hdr->size;
+	char **argv, *cwd;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		dup2(fds[i], i);
+		close(fds[i]);
+	}
+	close(fd);
+
+	argv = calloc(hdr->argc + 1, sizeof(*argv));
+	if (!argv)
+		exit(SERVER_EXIT_RETRY);
+	cwd = buf;
+	buf += strlen(buf) + 1;
+	for (i = 0; i < hdr->argc && buf < end; i++) {
+		argv[i] = buf;
+		buf += strlen(buf) + 1;
+	}
+	if (i != hdr->argc || chdir(cwd) < 0)
+		exit(SERVER_EXIT_RETRY);
+	clearenv();
+	for (i = 0; i < hdr->envc && buf < end; i++) {
+		putenv(buf);
+		buf += strlen(buf) + 1;
+	}
+
+	if (sparse_request(argv, filelist, &list) < 0)
+		exit(SERVER_EXIT_RETRY);
+	return list;
+}
+
+static void reply(int fd, int32_t val)
+{
+	write_all(fd, &val, sizeof(val));
+	close(fd);
+}
+
+static void reap_workers(void)
+{
+	int status, i;
+	pid_t pid;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		for (i = 0; i < workers_nr; i++) {
+			if (workers[i].pid != pid)
+				continue;
+			if (WIFEXITED(status) && WEXITSTATUS(status) == SERVER_EXIT_RETRY)
+				status = SERVER_RETRY;
+			reply(workers[i].fd, status);
+			workers[i] = workers[--workers_nr];
+			break;
+		}
+	}
+}
+
+static void add_worker(pid_t pid, int fd)
+{
+	workers = realloc(workers, (workers_nr + 1) * sizeof(*workers));
+	if (!workers)
+		die("out of memory");
+	workers[workers_nr].pid = pid;
+	workers[workers_nr].fd = fd;
+	workers_nr++;
+}
+
+static void sigchld_handler(int sig)
+{
+	int err = errno;
+
+	if (write(sigchld_pipe[1], "", 1) < 0)
+		;	// already full, it's fine
+	errno = err;
+}
+
+static void sigterm_handler(int sig)
+{
+	server_stop = 1;
+}
+
+static int server_listen(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (server_address(&addr, path) < 0)
+		die("server path too long: '%s'", path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("can't create the server socket: %s", strerror(errno));
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		int err = errno;
+
+		if (err != EADDRINUSE)
+			die("can't bind the server socket '%s': %s", path, strerror(err));
+		if (server_connect(path) >= 0)
+			die("a server is already running on '%s'", path);
+		// a stale socket
+		unlink(path);
+		if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+			die("can't bind the server socket '%s': %s", path, strerror(errno));
+	}
+	if (listen(fd, 64) < 0)
+		die("can't listen on the server socket '%s': %s", path, strerror(errno));
+	return fd;
+}
+
+//
+// Serve the requests on the socket 'path'.
+// This only returns in the children, with the request's initial
+// symbol list and its files in 'filelist'.
+//
+struct symbol_list *sparse_server(const char *path, struct string_list **filelist)
+{
+	struct sigaction sa = { 0 };
+	struct pollfd pfd[2];
+	int fd, i;
+
+	fd = server_listen(path);
+	if (pipe(sigchld_pipe) < 0)
+		die("can't create a pipe: %s", strerror(errno));
+
+	sa.sa_handler = sigchld_handler;
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &sa, NULL);
+	sa.sa_handler = sigterm_handler;
+	sa.sa_flags = 0;
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	pfd[0].fd = fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = sigchld_pipe[0];
+	pfd[1].events = POLLIN;
+	while (!server_stop) {
+		struct request_header hdr;
+		int fds[3];
+		char *buf;
+		pid_t pid;
+		int c;
+
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			die("poll failed: %s", strerror(errno));
+		}
+		if (pfd[1].revents) {
+			char tmp[64];
+
+			if (read(sigchld_pipe[0], tmp, sizeof(tmp)) < 0)
+				;	// nothing to drain
+			reap_workers();
+		}
+		if (!pfd[0].revents)
+			continue;
+
+		c = accept(fd, NULL, NULL);
+		if (c < 0)
+			continue;
+		if (read_request(c, fds, &buf, &hdr) < 0) {
+			reply(c, SERVER_RETRY);
+			continue;
+		}
+
+		fflush(stdout);
+		fflush(stderr);
+		pid = fork();
+		if (pid == 0) {
+			// the child only keeps the client's fds
+			close(fd);
+			close(sigchld_pipe[0]);
+			close(sigchld_pipe[1]);
+			for (i = 0; i < workers_nr; i++)
+				close(workers[i].fd);
+			signal(SIGCHLD, SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			signal(SIGINT, SIG_DFL);
+			signal(SIGHUP, SIG_DFL);
+			signal(SIGPIPE, SIG_DFL);
+			return start_request(c, fds, buf, &hdr, filelist);
+		}
+		for (i = 0; i < 3; i++)
+			close(fds[i]);
+		free(buf);
+		if (pid < 0) {
+			reply(c, SERVER_RETRY);
+			continue;
+		}
+		add_worker(pid, c);
+	}
+
+	unlink(path);
+	exit(0);
+}
@@ -271,8 +271,16 @@ static inline void rem_usage(pseudo_t p, pseudo_t *usep, int kill)
 {
 	if (has_use_list(p)) {
 		delete_pseudo_user_list_entry(&p->users, usep, 1);
-		if (kill && !p->users && has_definition(p))
+		if (!has_definition(p))
+			return;
+		if (kill && !p->users) {
 			kill_instruction(p->def);
+			return;
+		}
+		// the definition may now be dead or its last user simplified
+		queue_insn(p->def);
+		if (one_use(p))
+			queue_users(p);
 	}
 }
 
@@ -880,13 +888,13 @@ static int simplify_mask_shift(struct instruction *sh, unsigned long long mask)
 	return 0;
 }
 
-static pseudo_t eval_insn(struct instruction *insn)
+static pseudo_t eval_insn(struct instruction *insn, pseudo_t src1, pseudo_t src2)
 {
 	unsigned size = insn->size;
 
 	if (opcode_table[insn->opcode].flags & OPF_COMPARE)
 		size = insn->itype->bit_size;
-	return eval_op(insn->opcode, size, insn->src1, insn->src2);
+	return eval_op(insn->opcode, size, src1, src2);
 }
 
 static long long check_shift_count(struct instruction *insn, unsigned long long uval)
@@ -1640,7 +1648,7 @@ static int simplify_constant_leftside(struct instruction *insn)
 
 static int simplify_constant_binop(struct instruction *insn)
 {
-	pseudo_t res = eval_insn(insn);
+	pseudo_t res = eval_insn(insn, insn->src1, insn->src2);
 
 	if (!res)
 		return 0;
@@ -2098,9 +2106,9 @@ static int simplify_xor(struct instruction *insn)
 	       simplify_xor_one_side(insn, &insn->src2, &insn->src1);
 }
 
-static int simplify_constant_unop(struct instruction *insn)
+static pseudo_t eval_constant_unop(struct instruction *insn, pseudo_t src)
 {
-	long long val = insn->src1->value;
+	long long val = src->value;
 	long long res, mask;
 
 	switch (insn->opcode) {
@@ -2120,12 +2128,40 @@ static int simplify_constant_unop(struct instruction *insn)
 		res = val;
 		break;
 	default:
-		return 0;
+		return NULL;
 	}
 	mask = 1ULL << (insn->size-1);
 	res &= mask | (mask-1);
-	
-	return replace_with_value(insn, res);
+
+	return value_pseudo(res);
+}
+
+static int simplify_constant_unop(struct instruction *insn)
+{
+	pseudo_t res = eval_constant_unop(insn, insn->src1);
+
+	if (!res)
+		return 0;
+
+	return replace_with_pseudo(insn, res);
+}
+
+///
+// evaluate an instruction for some constant operands
+// @insn: the instruction to evaluate
+// @src1: the value of the first operand
+// @src2: the value of the second operand, if any
+// @return: the resulting value or NULL if it can't be computed.
+pseudo_t eval_constant(struct instruction *insn, pseudo_t src1, pseudo_t src2)
+{
+	switch (insn->opcode) {
+	case OP_BINARY ... OP_BINARY_END:
+	case OP_BINCMP ... OP_BINCMP_END:
+		return eval_insn(insn, src1, src2);
+	case OP_UNOP ... OP_UNOP_END:
+		return eval_constant_unop(insn, src1);
+	}
+	return NULL;
 }
 
 static int simplify_unop(struct instruction *insn)
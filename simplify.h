@@ -7,4 +7,6 @@ int simplify_instruction(struct instruction *insn);
 
 int replace_with_pseudo(struct instruction *insn, pseudo_t pseudo);
 
+pseudo_t eval_constant(struct instruction *insn, pseudo_t src1, pseudo_t src2);
+
 #endif
@@ -230,6 +230,9 @@ void sort_list(struct ptr_list **plist, int (*cmp)(const void *, const void *))
 	if (!head)
 		return;
 
+	// The big nodes of the vector lists don't fit in the merge buffer.
+	assert(!(head->kind & PTR_LIST_GROWING));
+
 	// Sort all the sub-lists
 	do {
 		array_sort(list->list, list->nr, cmp);
@@ -997,7 +997,7 @@ static void output_op_setfval(struct function *fn, struct instruction *insn)
 	LLVMTypeRef dtype = symbol_type(insn->type);
 	LLVMValueRef target;
 
-	target = LLVMConstReal(dtype, insn->fvalue);
+	target = LLVMConstReal(dtype, *insn->fvalue);
 	insn->target->priv = target;
 }
 
@@ -31,6 +31,10 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "lib.h"
 #include "allocate.h"
@@ -303,6 +307,7 @@ static void check_symbols(struct symbol_list *list)
 		struct entrypoint *ep;
 
 		expand_symbol(sym);
+		mark_ir_allocations();
 		ep = linearize_symbol(sym);
 		if (ep && ep->entry) {
 			if (dbg_entry)
@@ -310,6 +315,8 @@ static void check_symbols(struct symbol_list *list)
 
 			check_context(ep);
 		}
+		// the IR of this function isn't needed anymore
+		release_ir_allocations(ep);
 		if (dbg_compound)
 			list_compound_symbol(sym);
 	} END_FOR_EACH_PTR(sym);
@@ -318,16 +325,188 @@ static void check_symbols(struct symbol_list *list)
 		exit(1);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Parallel checking ('-j N')
+//
+// Each file is checked in its own process, forked once sparse_initialize()
+// is done, so all of them share the builtins, the predefined macros and
+// the '-include' files, and each file is checked in the same initial state
+// whatever the number of jobs. The diagnostics of a job are captured in
+// temporary files and copied, in the files' order, once it has finished.
+// At most 'jobs' processes are running and at most '2 * jobs' files are
+// pending (running or finished but waiting for an earlier one).
+
+struct job {
+	pid_t pid;
+	int out;
+	int err;
+	int status;
+	const char *file;
+};
+
+static int job_tmpfile(void)
+{
+	FILE *tmp = tmpfile();
+	int fd;
+
+	if (!tmp || (fd = dup(fileno(tmp))) < 0)
+		die("cannot create temporary file: %s", strerror(errno));
+	fclose(tmp);
+	return fd;
+}
+
+static void job_copy(int from, int to)
+{
+	char buf[8192];
+	ssize_t n;
+
+	lseek(from, 0, SEEK_SET);
+	while ((n = read(from, buf, sizeof(buf))) > 0) {
+		const char *p = buf;
+
+		while (n > 0) {
+			ssize_t w = write(to, p, n);
+			if (w < 0) {
+				if (errno == EINTR)
+					continue;
+				goto out;
+			}
+			p += w;
+			n -= w;
+		}
+	}
+out:
+	close(from);
+}
+
+static void job_start(struct job *job, char *file)
+{
+	job->file = file;
+	job->out = job_tmpfile();
+	job->err = job_tmpfile();
+	job->pid = fork();
+	if (job->pid < 0)
+		die("cannot fork: %s", strerror(errno));
+	if (job->pid == 0) {
+		// a single file is checked: nothing to reuse
+		token_cache = 0;
+		if (dup2(job->out, 1) < 0 || dup2(job->err, 2) < 0)
+			exit(1);
+		check_symbols(sparse(file));
+		// the statistics of this file, the parent has its own ones
+		report_stats();
+		exit(0);
+	}
+}
+
+static int job_status(const struct job *job)
+{
+	int status = job->status;
+
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+	fprintf(stderr, "%sthe check of '%s' was aborted (signal %d)\n",
+		diag_prefix, job->file, WTERMSIG(status));
+	return 1;
+}
+
+static int check_files_parallel(struct string_list *filelist)
+{
+	int nr = ptr_list_size((struct ptr_list *)filelist);
+	char **files = malloc(nr * sizeof(*files));
+	int max = jobs, window = 2 * jobs;
+	struct job *slots = calloc(window, sizeof(*slots));
+	int started = 0, running = 0, done = 0;
+	int status = 0;
+
+	if (!files || !slots)
+		die("out of memory");
+	linearize_ptr_list((struct ptr_list *)filelist, (void **)files, nr);
+
+	fflush(stdout);
+	fflush(stderr);
+	while (done < nr) {
+		struct job *job;
+		int wstatus;
+		pid_t pid;
+		int i;
+
+		// start as many jobs as allowed
+		while (started < nr && running < max && started - done < window) {
+			job_start(&slots[started % window], files[started]);
+			started++;
+			running++;
+		}
+
+		// wait for one of them
+		pid = waitpid(-1, &wstatus, 0);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			die("waitpid: %s", strerror(errno));
+		}
+		for (i = done; i < started; i++) {
+			job = &slots[i % window];
+			if (job->pid != pid)
+				continue;
+			job->status = wstatus;
+			job->pid = 0;
+			running--;
+			break;
+		}
+
+		// and output the results in order
+		while (done < started && !(job = &slots[done % window])->pid) {
+			job_copy(job->out, 1);
+			job_copy(job->err, 2);
+			done++;
+			status = job_status(job);
+			if (status)
+				goto out;
+		}
+	}
+
+out:
+	// an error occurred: same as in serial mode, stop here
+	for (; done < started; done++) {
+		struct job *job = &slots[done % window];
+
+		if (job->pid) {
+			kill(job->pid, SIGKILL);
+			waitpid(job->pid, NULL, 0);
+		}
+		close(job->out);
+		close(job->err);
+	}
+	free(slots);
+	free(files);
+	report_stats();
+	return status;
+}
+
 int main(int argc, char **argv)
 {
 	struct string_list *filelist = NULL;
+	struct symbol_list *list;
 	char *file;
+	int status;
+
+	// let the server do the check, if there is one
+	status = sparse_client(argc, argv);
+	if (status >= 0)
+		return status;
 
 	// by default ignore -o <file>
 	do_output = 0;
 
 	// Expand, linearize and show it.
-	check_symbols(sparse_initialize(argc, argv, &filelist));
+	list = sparse_initialize(argc, argv, &filelist);
+	if (server_path)
+		list = sparse_server(server_path, &filelist);
+	check_symbols(list);
+	if (jobs > 1 && ptr_list_multiple((struct ptr_list *)filelist))
+		return check_files_parallel(filelist);
+
 	FOR_EACH_PTR(filelist, file) {
 		check_symbols(sparse(file));
 	} END_FOR_EACH_PTR(file);
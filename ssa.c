@@ -124,16 +124,133 @@ static void rewrite_local_var(struct basic_block *bb, pseudo_t addr, int nbr_sto
 		kill_store(store);
 }
 
+///
+// per-conversion state
+// --------------------
+// The blocks' marks are indexed by their postorder number and are
+// valid for the variable whose stamp they hold.
+struct ssa_mark {
+	unsigned int store;		// the block stores the variable
+	unsigned int load;		// the block loads the variable
+	unsigned int live;		// the variable is live at the block's entry
+	unsigned int phi;		// the block is in the variable's IDF
+	struct phi_map *defs;		// the definitions reaching the block's end
+};
+
+// a variable being renamed
+struct ssa_var {
+	struct symbol *sym;
+	struct instruction *def;	// the current reaching definition
+	void *aux;			// the symbol's saved ->aux
+};
+
+// an entry of the renaming's undo log
+struct ssa_undo {
+	struct ssa_var *var;
+	struct instruction *def;
+};
+
+static struct ssa_mark *marks;
+static unsigned int stamp;
+static struct basic_block **work;
+static struct basic_block_list **frontiers;
+static struct ssa_var *vars;
+static int nbr_vars;
+
+// Is the first access to @addr in @bb a load?
+static bool load_first(struct basic_block *bb, pseudo_t addr)
+{
+	struct instruction *insn;
+
+	FOR_EACH_PTR(bb->insns, insn) {
+		if (!insn->bb || insn->src != addr)
+			continue;
+		switch (insn->opcode) {
+		case OP_LOAD:
+			return true;
+		case OP_STORE:
+			return false;
+		}
+	} END_FOR_EACH_PTR(insn);
+	return false;
+}
+
+//
+// mark the blocks where the variable is live-in
+//
+// A block is live-in if it loads the variable before storing it
+// or if it doesn't store it and one of its children is live-in.
+static void var_liveness(struct basic_block_list *loads, pseudo_t addr)
+{
+	struct basic_block *bb;
+	int top = 0;
+
+	FOR_EACH_PTR(loads, bb) {
+		struct ssa_mark *mark = &marks[bb->postorder_nr];
+
+		if (mark->store == stamp && !load_first(bb, addr))
+			continue;
+		mark->live = stamp;
+		work[top++] = bb;
+	} END_FOR_EACH_PTR(bb);
+
+	while (top) {
+		struct basic_block *parent;
+
+		bb = work[--top];
+		FOR_EACH_PTR(bb->parents, parent) {
+			struct ssa_mark *mark = &marks[parent->postorder_nr];
+
+			if (mark->live == stamp || mark->store == stamp)
+				continue;
+			mark->live = stamp;
+			work[top++] = parent;
+		} END_FOR_EACH_PTR(parent);
+	}
+}
+
+//
+// insert the phi-nodes needed by a variable
+//
+// They're placed at the iterated dominance frontier of the stores
+// but only where the variable is live (pruned SSA).
+static void var_place_phis(struct symbol *var, struct basic_block_list *alpha)
+{
+	struct basic_block *bb;
+	int top = 0;
+
+	FOR_EACH_PTR(alpha, bb) {
+		work[top++] = bb;
+	} END_FOR_EACH_PTR(bb);
+
+	while (top) {
+		struct basic_block *df;
+
+		bb = work[--top];
+		FOR_EACH_PTR(frontiers[bb->postorder_nr], df) {
+			struct ssa_mark *mark = &marks[df->postorder_nr];
+
+			if (mark->phi == stamp)
+				continue;
+			mark->phi = stamp;
+			if (mark->live == stamp) {
+				struct instruction *node = insert_phi_node(df, var);
+				node->phi_var = var->pseudo;
+			}
+			if (mark->store != stamp)
+				work[top++] = df;
+		} END_FOR_EACH_PTR(df);
+	}
+}
+
 // we would like to know:
 // is there one or more stores?
 // are all loads & stores local/done in a single block?
 static void ssa_convert_one_var(struct entrypoint *ep, struct symbol *var)
 {
-	unsigned long generation = ++bb_generation;
 	struct basic_block_list *alpha = NULL;
-	struct basic_block_list *idf = NULL;
+	struct basic_block_list *loads = NULL;
 	struct basic_block *samebb = NULL;
-	struct basic_block *bb;
 	struct pseudo_user *pu;
 	unsigned long mod = var->ctype.modifiers;
 	bool local = true;
@@ -158,20 +275,27 @@ static void ssa_convert_one_var(struct entrypoint *ep, struct symbol *var)
 	if (!is_promotable(var))
 		return;
 
-	// 1) insert in the worklist all BBs that may modify var
+	// 1) collect the blocks that modify or read var
+	stamp++;
 	FOR_EACH_PTR(addr->users, pu) {
 		struct instruction *insn = pu->insn;
 		struct basic_block *bb = insn->bb;
+		struct ssa_mark *mark = &marks[bb->postorder_nr];
 
 		switch (insn->opcode) {
 		case OP_STORE:
 			nbr_stores++;
-			if (bb->generation != generation) {
-				bb->generation = generation;
+			if (mark->store != stamp) {
+				mark->store = stamp;
 				add_bb(&alpha, bb);
 			}
-			/* fall through */
+			goto access;
 		case OP_LOAD:
+			if (mark->load != stamp) {
+				mark->load = stamp;
+				add_bb(&loads, bb);
+			}
+		access:
 			if (local) {
 				if (!samebb)
 					samebb = bb;
@@ -194,36 +318,69 @@ static void ssa_convert_one_var(struct entrypoint *ep, struct symbol *var)
 	// FIXME: could be done for extended BB too
 	if (local) {
 		rewrite_local_var(samebb, addr, nbr_stores, nbr_uses);
-		return;
+		goto out;
 	}
 
-	idf_compute(ep, &idf, alpha);
-	FOR_EACH_PTR(idf, bb) {
-		struct instruction *node = insert_phi_node(bb, var);
-		node->phi_var = var->pseudo;
-	} END_FOR_EACH_PTR(bb);
+	// 2) place the phi-nodes where var is live
+	var_liveness(loads, addr);
+	var_place_phis(var, alpha);
+
+	vars[nbr_vars].sym = var;
+	vars[nbr_vars].aux = var->aux;
+	var->aux = &vars[nbr_vars++];
 	var->torename = 1;
 
 external_visibility:
 	if (mod & (MOD_NONLOCAL | MOD_STATIC))
-		return;
+		goto out;
 	kill_dead_stores(ep, addr, !mod);
+
+out:
+	free_ptr_list(&alpha);
+	free_ptr_list(&loads);
 }
 
-static struct instruction *lookup_var(struct basic_block *bb, struct symbol *var)
+static struct ssa_var *renamed_var(pseudo_t addr)
 {
-	do {
-		struct instruction *insn = phi_map_lookup(bb->phi_map, var);
-		if (insn)
-			return insn;
-	} while ((bb = bb->idom));
-	return NULL;
+	struct symbol *var;
+
+	if (addr->type != PSEUDO_SYM)
+		return NULL;
+	var = addr->sym;
+	if (!var || !var->torename)
+		return NULL;
+	return var->aux;
 }
 
 static struct instruction_list *phis_all;
 static struct instruction_list *phis_used;
 static struct instruction_list *stores;
 
+static struct ssa_undo *undo;
+static unsigned int undo_nr, undo_max;
+
+static void set_def(struct ssa_var *var, struct instruction *def)
+{
+	if (undo_nr == undo_max) {
+		undo_max = undo_max ? 2 * undo_max : 64;
+		undo = realloc(undo, undo_max * sizeof(*undo));
+		if (!undo)
+			die("out of memory");
+	}
+	undo[undo_nr].var = var;
+	undo[undo_nr].def = var->def;
+	undo_nr++;
+	var->def = def;
+}
+
+static void undo_defs(unsigned int nr)
+{
+	while (undo_nr > nr) {
+		struct ssa_undo *entry = &undo[--undo_nr];
+		entry->var->def = entry->def;
+	}
+}
+
 static bool matching_load(struct instruction *def, struct instruction *insn)
 {
 	if (insn->size != def->size)
@@ -244,61 +401,127 @@ static bool matching_load(struct instruction *def, struct instruction *insn)
 static void ssa_rename_insn(struct basic_block *bb, struct instruction *insn)
 {
 	struct instruction *def;
-	struct symbol *var;
-	pseudo_t addr;
+	struct ssa_var *var;
 	pseudo_t val;
 
 	switch (insn->opcode) {
 	case OP_STORE:
-		addr = insn->src;
-		if (addr->type != PSEUDO_SYM)
-			break;
-		var = addr->sym;
-		if (!var || !var->torename)
+		var = renamed_var(insn->src);
+		if (!var)
 			break;
-		phi_map_update(&bb->phi_map, var, insn);
+		set_def(var, insn);
 		add_instruction(&stores, insn);
 		break;
 	case OP_LOAD:
-		addr = insn->src;
-		if (addr->type != PSEUDO_SYM)
+		var = renamed_var(insn->src);
+		if (!var)
 			break;
-		var = addr->sym;
-		if (!var || !var->torename)
-			break;
-		def = lookup_var(bb, var);
+		def = var->def;
 		if (!def) {
 			val = undef_pseudo();
 		} else if (!matching_load(def, insn)) {
-			var->torename = false;
+			var->sym->torename = false;
 			break;
 		} else {
 			val = def->target;
 		}
-		replace_with_pseudo(insn, val);
+		// the address' user list is cleaned up in one go at the end
+		convert_instruction_target(insn, val);
+		insn->src = VOID;
+		insn->bb = NULL;
 		break;
 	case OP_PHI:
-		var = insn->type;
-		if (!var || !var->torename)
+		if (!insn->phi_var)
+			break;
+		var = renamed_var(insn->phi_var);
+		if (!var)
 			break;
-		phi_map_update(&bb->phi_map, var, insn);
-		add_instruction(&phis_all, insn);
+		set_def(var, insn);
 		break;
 	}
 }
 
-static void ssa_rename_insns(struct entrypoint *ep)
+//
+// record the definitions reaching the end of @bb
+// for the phi-nodes of its children
+static void ssa_rename_edges(struct basic_block *bb)
 {
+	struct phi_map **map = &marks[bb->postorder_nr].defs;
+	struct basic_block *child;
+
+	FOR_EACH_PTR(bb->children, child) {
+		struct instruction *insn;
+
+		FOR_EACH_PTR(child->insns, insn) {
+			struct ssa_var *var;
+
+			if (!insn->bb)
+				continue;
+			if (insn->opcode != OP_PHI)
+				break;
+			if (!insn->phi_var)
+				continue;
+			var = renamed_var(insn->phi_var);
+			if (!var)
+				continue;
+			phi_map_update(map, var->sym, var->def);
+		} END_FOR_EACH_PTR(insn);
+	} END_FOR_EACH_PTR(child);
+}
+
+//
+// rename the loads & stores in a single walk of the dominance tree
+//
+// The blocks are visited in the tree's preorder while keeping
+// the stack of the blocks dominating the current one.
+static void ssa_rename_insns(struct entrypoint *ep, unsigned int size)
+{
+	struct basic_block **order = calloc(2 * size, sizeof(*order));
+	struct basic_block **stack = work;
+	unsigned int *heights = calloc(size, sizeof(*heights));
 	struct basic_block *bb;
+	unsigned int i;
+	int top = 0;
 
 	FOR_EACH_PTR(ep->bbs, bb) {
+		order[bb->dom_pre] = bb;
+	} END_FOR_EACH_PTR(bb);
+
+	for (i = 0; i < 2 * size; i++) {
 		struct instruction *insn;
+
+		if (!(bb = order[i]))
+			continue;
+		while (top && !domtree_dominates(stack[top-1], bb))
+			undo_defs(heights[--top]);
+		heights[top] = undo_nr;
+		stack[top++] = bb;
+
 		FOR_EACH_PTR(bb->insns, insn) {
 			if (!insn->bb)
 				continue;
 			ssa_rename_insn(bb, insn);
 		} END_FOR_EACH_PTR(insn);
+		ssa_rename_edges(bb);
+	}
+	undo_defs(0);
+
+	// the phi-nodes, in the CFG's order
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *insn;
+
+		FOR_EACH_PTR(bb->insns, insn) {
+			if (!insn->bb)
+				continue;
+			if (insn->opcode != OP_PHI)
+				break;
+			if (insn->phi_var && renamed_var(insn->phi_var))
+				add_instruction(&phis_all, insn);
+		} END_FOR_EACH_PTR(insn);
 	} END_FOR_EACH_PTR(bb);
+
+	free(heights);
+	free(order);
 }
 
 static void mark_phi_used(pseudo_t val)
@@ -327,7 +550,7 @@ static void ssa_rename_phi(struct instruction *insn)
 	if (!var->torename)
 		return;
 	FOR_EACH_PTR(insn->bb->parents, par) {
-		struct instruction *def = lookup_var(par, var);
+		struct instruction *def = phi_map_lookup(marks[par->postorder_nr].defs, var);
 		pseudo_t val = def ? def->target : undef_pseudo();
 		struct instruction *phisrc = alloc_phisrc(val, var);
 		pseudo_t phi = phisrc->target;
@@ -355,6 +578,8 @@ static void ssa_rename_phis(struct entrypoint *ep)
 			continue;
 		ssa_rename_phi(phi);
 	} END_FOR_EACH_PTR(phi);
+	free_ptr_list(&phis_all);
+	free_ptr_list(&phis_used);
 }
 
 static void remove_dead_stores(struct instruction_list *stores)
@@ -364,26 +589,50 @@ static void remove_dead_stores(struct instruction_list *stores)
 	FOR_EACH_PTR(stores, store) {
 		struct symbol *var = store->addr->sym;
 
-		if (var->torename)
-			kill_store(store);
+		if (var->torename) {
+			remove_use(&store->target);
+			store->src = VOID;
+			store->bb = NULL;
+		}
 	} END_FOR_EACH_PTR(store);
 }
 
+// drop the dead loads & stores from the variables' user lists
+static void remove_dead_users(void)
+{
+	int i;
+
+	for (i = 0; i < nbr_vars; i++) {
+		struct symbol *var = vars[i].sym;
+		struct pseudo_user_list **list = &var->pseudo->users;
+		struct pseudo_user *pu;
+
+		FOR_EACH_PTR(*list, pu) {
+			if (!pu->insn->bb)
+				MARK_CURRENT_DELETED(pu);
+		} END_FOR_EACH_PTR(pu);
+		if (pseudo_user_list_empty(*list))
+			*list = NULL;
+		var->aux = vars[i].aux;
+	}
+}
+
 void ssa_convert(struct entrypoint *ep)
 {
+	unsigned int size = 0;
 	struct basic_block *bb;
 	pseudo_t pseudo;
-	int first, last;
 
-	// calculate the number of BBs
-	first = ep->entry->bb->nr;
-	last = first;
+	// the dominance tree and the postorder are up-to-date
 	FOR_EACH_PTR(ep->bbs, bb) {
-		int nr = bb->nr;
-		if (nr > last)
-			last = nr;
-		bb->phi_map = NULL;
+		size++;
 	} END_FOR_EACH_PTR(bb);
+	marks = calloc(size, sizeof(*marks));
+	work = calloc(size, sizeof(*work));
+	frontiers = df_compute(ep, size);
+	vars = calloc(ptr_list_size((struct ptr_list *)ep->accesses), sizeof(*vars));
+	nbr_vars = 0;
+	stamp = 0;
 
 	// try to promote memory accesses to pseudos
 	stores = NULL;
@@ -393,9 +642,18 @@ void ssa_convert(struct entrypoint *ep)
 
 	// rename the converted accesses
 	phis_all = phis_used = NULL;
-	ssa_rename_insns(ep);
-	ssa_rename_phis(ep);
+	if (nbr_vars) {
+		ssa_rename_insns(ep, size);
+		ssa_rename_phis(ep);
+	}
 
 	// remove now dead stores
 	remove_dead_stores(stores);
+	free_ptr_list(&stores);
+	remove_dead_users();
+
+	df_free(frontiers, size);
+	free(vars);
+	free(work);
+	free(marks);
 }
@@ -1,9 +1,19 @@
 #include <stdio.h>
+#include <time.h>
 #include "allocate.h"
 #include "linearize.h"
 #include "storage.h"
+#include "token.h"
+#include "symbol.h"
+#include "optimize.h"
+#include "ptrmap.h"
+#include "stats.h"
 
 __DECLARE_ALLOCATOR(struct ptr_list, ptrlist);
+DECLARE_ALLOCATOR(ptrmap);
+__DECLARE_ALLOCATOR(struct ptrpair, ptrmap_hash);
+__DECLARE_ALLOCATOR(struct ptrmap, ir_ptrmap);
+__DECLARE_ALLOCATOR(struct ptrpair, ir_ptrmap_hash);
 
 
 typedef void (*get_t)(struct allocator_stats*);
@@ -43,9 +53,17 @@ void show_allocation_stats(void)
 	show_stats(get_pseudo_stats, &tot);
 	show_stats(get_pseudo_user_stats, &tot);
 	show_stats(get_ptrlist_stats, &tot);
+	show_stats(get_ptrvec_stats, &tot);
+	show_stats(get_ir_ptrlist_stats, &tot);
+	show_stats(get_ptrmap_stats, &tot);
+	show_stats(get_ptrmap_hash_stats, &tot);
+	show_stats(get_ir_ptrmap_stats, &tot);
+	show_stats(get_ir_ptrmap_hash_stats, &tot);
+	show_stats(get_ptrmap_table_stats, &tot);
 	show_stats(get_multijmp_stats, &tot);
 	show_stats(get_asm_rules_stats, &tot);
 	show_stats(get_asm_constraint_stats, &tot);
+	show_stats(get_fvalue_stats, &tot);
 	show_stats(get_context_stats, &tot);
 	show_stats(get_string_stats, &tot);
 	show_stats(get_bytes_stats, &tot);
@@ -55,8 +73,170 @@ void show_allocation_stats(void)
 	show_stats(NULL, &tot);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// -ftime-report
+
+struct phase_stats {
+	const char *name;
+	double wall, cpu;
+	unsigned long peak;	// the allocators' peak bytes during the phase
+	unsigned long count;
+};
+
+static struct phase_stats phases[PHASE_NR] = {
+	[PHASE_OTHER]		= { "other" },
+	[PHASE_TOKENIZE]	= { "tokenize" },
+	[PHASE_PREPROCESS]	= { "preprocess" },
+	[PHASE_PARSE]		= { "parse" },
+	[PHASE_EVALUATE]	= { "evaluate" },
+	[PHASE_EXPAND]		= { "expand" },
+	[PHASE_LINEARIZE]	= { "linearize" },
+	[PHASE_OPTIMIZE]	= { "optimize" },
+	[PHASE_SSA]		= { "ssa_convert" },
+	[PHASE_SCCP]		= { "sccp" },
+	[PHASE_MEMOPS]		= { "simplify_memops" },
+	[PHASE_CSE]		= { "cse_eliminate" },
+	[PHASE_DOMTREE]		= { "domtree" },
+	[PHASE_LIVENESS]	= { "liveness" },
+	[PHASE_FLOW]		= { "simplify_flow" },
+};
+
+#define PHASE_DEPTH	32
+
+static struct {
+	enum time_phase phase;
+	double start;
+	unsigned long visited;
+} phase_stack[PHASE_DEPTH];
+static int phase_depth;
+static double last_wall, last_cpu;
+
+struct function_time {
+	struct ident *ident;
+	struct position pos;
+	double wall;
+	unsigned long visited;	// instructions visited by the simplification
+};
+
+static struct function_time *slowest;
+static unsigned int slowest_nr;
+
+static double get_time(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// account the time since the last change to the current phase
+static double phase_account(void)
+{
+	enum time_phase phase = phase_depth ? phase_stack[phase_depth - 1].phase : PHASE_OTHER;
+	struct phase_stats *p = &phases[phase];
+	double wall = get_time(CLOCK_MONOTONIC);
+	double cpu = get_time(CLOCK_PROCESS_CPUTIME_ID);
+
+	if (last_wall) {
+		p->wall += wall - last_wall;
+		p->cpu += cpu - last_cpu;
+	}
+	last_wall = wall;
+	last_cpu = cpu;
+
+	if (alloc_peak_bytes > p->peak)
+		p->peak = alloc_peak_bytes;
+	alloc_peak_bytes = alloc_bytes;
+	return wall;
+}
+
+void __phase_start(enum time_phase phase)
+{
+	double now = phase_account();
+
+	phases[phase].count++;
+	if (phase_depth < PHASE_DEPTH) {
+		phase_stack[phase_depth].phase = phase;
+		phase_stack[phase_depth].start = now;
+		phase_stack[phase_depth].visited = insns_visited;
+	}
+	phase_depth++;
+}
+
+static void function_time(struct symbol *sym, double wall, unsigned long visited)
+{
+	unsigned int n = ftime_report;
+	unsigned int i;
+
+	if (!slowest)
+		slowest = calloc(n, sizeof(*slowest));
+	if (!slowest || wall <= slowest[n - 1].wall)
+		return;
+
+	// keep the slowest ones, sorted
+	for (i = n - 1; i > 0 && slowest[i - 1].wall < wall; i--)
+		slowest[i] = slowest[i - 1];
+	slowest[i].ident = sym->ident;
+	slowest[i].pos = sym->pos;
+	slowest[i].wall = wall;
+	slowest[i].visited = visited;
+	if (slowest_nr < n)
+		slowest_nr++;
+}
+
+void __phase_end(enum time_phase phase, struct symbol *sym)
+{
+	double now = phase_account();
+
+	if (!phase_depth)
+		return;
+	phase_depth--;
+	if (sym && phase_depth < PHASE_DEPTH)
+		function_time(sym, now - phase_stack[phase_depth].start,
+			insns_visited - phase_stack[phase_depth].visited);
+}
+
+static void show_time_report(void)
+{
+	double wall = 0, cpu = 0;
+	unsigned int i;
+
+	phase_account();
+	fprintf(stderr, "%16s: %8s, %10s, %10s, %6s, %12s\n", "phase", "count",
+		"wall (s)", "cpu (s)", "%wall", "peak (KB)");
+	for (i = 0; i < PHASE_NR; i++) {
+		wall += phases[i].wall;
+		cpu += phases[i].cpu;
+	}
+	for (i = 0; i < PHASE_NR; i++) {
+		const struct phase_stats *p = &phases[i];
+
+		fprintf(stderr, "%16s: %8lu, %10.4f, %10.4f, %5.1f%%, %12lu\n",
+			p->name, p->count, p->wall, p->cpu,
+			100 * p->wall / (wall ? : 1), p->peak / 1024);
+	}
+	fprintf(stderr, "%16s: %8s, %10.4f, %10.4f\n", "total", "", wall, cpu);
+	fprintf(stderr, "%16s: %8lu\n", "simplify visits", insns_visited);
+
+	if (!slowest_nr)
+		return;
+	fprintf(stderr, "slowest functions (time, instructions visited by the simplification):\n");
+	for (i = 0; i < slowest_nr; i++) {
+		const struct function_time *f = &slowest[i];
+
+		fprintf(stderr, "%10.4f s %8lu  %s:%d:%d: %s\n", f->wall, f->visited,
+			stream_name(f->pos.stream), f->pos.line, f->pos.pos,
+			show_ident(f->ident));
+	}
+}
+
 void report_stats(void)
 {
-	if (fmem_report)
+	if (fmem_report) {
 		show_allocation_stats();
+		show_token_cache_stats();
+		show_include_cache_stats();
+	}
+	if (ftime_report)
+		show_time_report();
 }
@@ -0,0 +1,53 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "options.h"
+
+struct symbol;
+
+/*
+ * The phases timed by -ftime-report.
+ * When nested, the time is only accounted to the innermost phase.
+ */
+enum time_phase {
+	PHASE_OTHER,
+	PHASE_TOKENIZE,
+	PHASE_PREPROCESS,
+	PHASE_PARSE,
+	PHASE_EVALUATE,
+	PHASE_EXPAND,
+	PHASE_LINEARIZE,
+	PHASE_OPTIMIZE,
+	PHASE_SSA,
+	PHASE_SCCP,
+	PHASE_MEMOPS,
+	PHASE_CSE,
+	PHASE_DOMTREE,
+	PHASE_LIVENESS,
+	PHASE_FLOW,
+	PHASE_NR
+};
+
+extern void __phase_start(enum time_phase phase);
+extern void __phase_end(enum time_phase phase, struct symbol *sym);
+
+static inline void phase_start(enum time_phase phase)
+{
+	if (ftime_report)
+		__phase_start(phase);
+}
+
+static inline void phase_end(enum time_phase phase)
+{
+	if (ftime_report)
+		__phase_end(phase, NULL);
+}
+
+// also account the phase's whole time to the function 'sym'
+static inline void phase_end_function(enum time_phase phase, struct symbol *sym)
+{
+	if (ftime_report)
+		__phase_end(phase, sym);
+}
+
+#endif
@@ -37,6 +37,7 @@
 #include "evaluate.h"
 
 #include "target.h"
+#include "ptrmap.h"
 
 /*
  * Secondary symbol list for stuff that needs to be output because it
@@ -61,7 +62,7 @@ struct symbol *lookup_symbol(struct ident *ident, enum namespace ns)
 {
 	struct symbol *sym;
 
-	for (sym = ident->symbols; sym; sym = sym->next_id) {
+	for (sym = *ident_bindings(ident, ns); sym; sym = sym->next_id) {
 		if (sym->namespace & ns) {
 			sym->used = 1;
 			return sym;
@@ -201,6 +202,82 @@ static void examine_anonymous_member(struct symbol *sym)
 	} END_FOR_EACH_PTR(sub);
 }
 
+///
+// index of the members of big structs or unions
+//
+// It maps the identifiers of the members to the member holding them:
+// the member itself or, for the members of anonymous structs or unions,
+// the anonymous member containing them.
+DECLARE_PTRMAP(member_map, struct ident *, struct symbol *);
+
+#define MEMBER_INDEX_MIN	16
+
+static struct symbol *anonymous_type(struct symbol *member)
+{
+	struct symbol *type = member->ctype.base_type;
+
+	if (member->ident || !type)
+		return NULL;
+	if (type->type != SYM_STRUCT && type->type != SYM_UNION)
+		return NULL;
+	return type;
+}
+
+static void index_members(struct member_map **map, struct symbol *type, struct symbol *top)
+{
+	struct symbol *member;
+
+	FOR_EACH_PTR(type->symbol_list, member) {
+		struct symbol *sub = anonymous_type(member);
+
+		if (sub) {
+			index_members(map, sub, top ?: member);
+			continue;
+		}
+		if (!member->ident)
+			continue;
+		// in case of duplicates, the first one is the one used
+		if (!member_map_lookup(*map, member->ident))
+			member_map_add(map, member->ident, top ?: member);
+	} END_FOR_EACH_PTR(member);
+}
+
+///
+// find a member of a struct or union, also in its anonymous members
+// @type: the struct or union
+// @ident: the name of the member
+// @offset: incremented by the offset of the member, in bytes
+// @return: the member or NULL if not found.
+struct symbol *find_struct_member(struct symbol *type, struct ident *ident, int *offset)
+{
+	struct symbol *member, *sub;
+
+	if (type->members) {
+		member = member_map_lookup(type->members, ident);
+		if (!member)
+			return NULL;
+		*offset += member->offset;
+		if (member->ident)
+			return member;
+		return find_struct_member(member->ctype.base_type, ident, offset);
+	}
+
+	FOR_EACH_PTR(type->symbol_list, member) {
+		if (member->ident == ident) {
+			*offset += member->offset;
+			return member;
+		}
+		if (!(sub = anonymous_type(member)))
+			continue;
+		sub = find_struct_member(sub, ident, offset);
+		if (sub) {
+			*offset += member->offset;
+			return sub;
+		}
+	} END_FOR_EACH_PTR(member);
+	return NULL;
+}
+
 static struct symbol * examine_struct_union_type(struct symbol *sym, int advance)
 {
 	struct struct_union_info info = {
@@ -251,6 +328,10 @@ static struct symbol * examine_struct_union_type(struct symbol *sym, int advance
 	if (info.has_flex_array && (!is_union_type(sym) || Wflexible_array_union))
 		sym->has_flex_array = 1;
 	sym->bit_size = bit_size;
+
+	// the members are known now, index them if there are many
+	if (!sym->members && symbol_list_size(sym->symbol_list) >= MEMBER_INDEX_MIN)
+		index_members(&sym->members, sym, NULL);
 	return sym;
 }
 
@@ -744,6 +825,8 @@ static void inherit_static(struct symbol *sym)
 
 void bind_symbol_with_scope(struct symbol *sym, struct ident *ident, enum namespace ns, struct scope *scope)
 {
+	struct symbol **bindings;
+
 	if (sym->bound) {
 		sparse_error(sym->pos, "internal error: symbol type already bound");
 		return;
@@ -753,8 +836,9 @@ void bind_symbol_with_scope(struct symbol *sym, struct ident *ident, enum namesp
 		return;
 	}
 	sym->namespace = ns;
-	sym->next_id = ident->symbols;
-	ident->symbols = sym;
+	bindings = ident_bindings(ident, ns);
+	sym->next_id = *bindings;
+	*bindings = sym;
 	if (sym->ident && sym->ident != ident)
 		warning(sym->pos, "Symbol '%s' already bound", show_ident(sym->ident));
 	sym->ident = ident;
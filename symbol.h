@@ -119,6 +119,7 @@ struct decl_state {
 struct pseudo;
 struct entrypoint;
 struct arg;
+struct member_map;
 
 struct symbol_op {
 	enum keyword type;
@@ -150,7 +151,7 @@ struct symbol {
 	struct position pos;		/* Where this symbol was declared */
 	struct position endpos;		/* Where this symbol ends*/
 	struct ident *ident;		/* What identifier this symbol is associated with */
-	struct symbol *next_id;		/* Next semantic symbol that shares this identifier */
+	struct symbol *next_id;		/* Next symbol sharing this identifier & namespace class */
 	struct symbol	*replace;	/* What is this symbol shadowed by in copy-expression */
 	struct scope	*scope;
 	union {
@@ -208,6 +209,9 @@ struct symbol {
 			struct expression *cleanup;
 			struct entrypoint *ep;
 			struct symbol *definition;
+			struct member_map *members;	/* index of big structs & unions */
+			struct symbol *derived;		/* the interned types derived from this one */
+			struct symbol *next_derived;	/* next type derived from the same one */
 		};
 	};
 	union /* backend */ {
@@ -352,6 +356,7 @@ extern void bind_symbol_with_scope(struct symbol *, struct ident *, enum namespa
 
 extern struct symbol *examine_symbol_type(struct symbol *);
 extern struct symbol *examine_pointer_target(struct symbol *);
+extern struct symbol *find_struct_member(struct symbol *type, struct ident *ident, int *offset);
 extern const char *show_as(struct ident *as);
 extern const char *show_typename(struct symbol *sym);
 extern const char *builtin_typename(struct symbol *sym);
@@ -554,6 +559,24 @@ static inline long long extend_value(long long val, struct symbol *ctype)
 	return bits_extend(val, size, is_signed);
 }
 
+///
+// the chain of bindings of an identifier in a class of namespaces
+//
+// Each chain only holds namespaces which can shadow each other, so
+// a lookup mask must not span more than one class.
+static inline struct symbol **ident_bindings(struct ident *ident, enum namespace ns)
+{
+	if (ns & (NS_SYMBOL | NS_TYPEDEF))
+		return &ident->symbols;
+	if (ns & NS_STRUCT)
+		return &ident->tags;
+	if (ns & NS_LABEL)
+		return &ident->labels;
+	if (ns & (NS_MACRO | NS_UNDEF))
+		return &ident->macros;
+	return &ident->keywords;
+}
+
 static inline struct symbol *lookup_keyword(struct ident *ident, enum namespace ns)
 {
 	if (!ident->keyword)
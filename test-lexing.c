@@ -30,15 +30,79 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include "token.h"
 #include "symbol.h"
+#include "allocate.h"
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Micro-benchmark of the lexer alone: tokenize the whole content
+ * of the file, already in memory, 'loops' times.
+ */
+static void bench(const char *file, unsigned int loops)
+{
+	unsigned long nr = 0;
+	unsigned int i;
+	struct stat st;
+	double t;
+	char *buf;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0)
+		die("can't open '%s'", file);
+	buf = malloc(st.st_size + 1);
+	if (read(fd, buf, st.st_size) != st.st_size)
+		die("can't read '%s'", file);
+	buf[st.st_size] = '\0';	// the lexer's sentinel
+	close(fd);
+
+	t = now();
+	for (i = 0; i < loops; i++) {
+		struct token *token, *end;
+
+		token = tokenize_buffer(buf, st.st_size, &end);
+		for (; !eof_token(token); token = token->next)
+			nr++;
+		clear_token_alloc();
+	}
+	t = now() - t;
+
+	printf("%s: %lld bytes, %lu tokens, %.2f MB/s, %.1f ns/token\n",
+		file, (long long)st.st_size, nr / loops,
+		st.st_size * (double)loops / t / 1e6, t * 1e9 / (nr ? nr : 1));
+	free(buf);
+}
 
 int main(int argc, char **argv)
 {
 	struct string_list *filelist = NULL;
+	unsigned int loops = 0;
 	char *file;
 
+	if (argc > 1 && !strncmp(argv[1], "--bench=", 8)) {
+		loops = strtoul(argv[1] + 8, NULL, 0);
+		argv[1] = argv[0];
+		argv++, argc--;
+	}
+	if (loops) {
+		sparse_initialize(argc, argv, &filelist);
+		FOR_EACH_PTR(filelist, file) {
+			bench(file, loops);
+		} END_FOR_EACH_PTR(file);
+		return 0;
+	}
+
 	preprocess_only = 1;
 	sparse_initialize(argc, argv, &filelist);
 	FOR_EACH_PTR(filelist, file) {
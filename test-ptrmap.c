@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: MIT
+//
+// Exercise the pointer maps beyond what sparse itself does with them:
+// the maps are grown from a few linear blocks to big hashed tables,
+// then walked, and their pairs deleted & added again.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ptrmap.h"
+
+DECLARE_PTRMAP(test_map, long *, long *);
+DECLARE_IR_PTRMAP(test_ir_map, long *, long *);
+
+#define NR_KEYS	5000
+
+static long keys[NR_KEYS];
+static long vals[NR_KEYS];
+static unsigned char seen[NR_KEYS];
+static int errors;
+
+static void check(int cond, const char *what, int nr, int i)
+{
+	if (cond)
+		return;
+	printf("map of %d: %s (key %d)\n", nr, what, i);
+	errors++;
+}
+
+static int present(int i)
+{
+	return i % 3 != 0;
+}
+
+// all the pairs must be there, and only once
+static void check_walk(struct ptrmap *map, int nr, int (*expected)(int))
+{
+	struct ptrmap_iter iter = { };
+	void *key, *val;
+	int i;
+
+	memset(seen, 0, nr);
+	while (__ptrmap_next(map, &iter, &key, &val)) {
+		long *k = key;
+
+		i = k - keys;
+		check(i >= 0 && i < nr, "unknown key", nr, i);
+		if (i < 0 || i >= nr)
+			continue;
+		check(val == &vals[i], "bad value", nr, i);
+		check(!seen[i], "key walked twice", nr, i);
+		seen[i] = 1;
+	}
+	for (i = 0; i < nr; i++)
+		check(seen[i] == expected(i), seen[i] ? "deleted key walked" : "key not walked", nr, i);
+}
+
+static int all(int i)
+{
+	return 1;
+}
+
+static int none(int i)
+{
+	return 0;
+}
+
+static void check_lookups(struct test_map *map, int nr, int (*expected)(int))
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		long *val = test_map_lookup(map, &keys[i]);
+
+		check(val == (expected(i) ? &vals[i] : NULL), "bad lookup", nr, i);
+	}
+}
+
+static void test_map(int nr)
+{
+	struct test_map *map = NULL;
+	int i;
+
+	for (i = 0; i < nr; i++)
+		test_map_add(&map, &keys[i], &vals[i]);
+	check_lookups(map, nr, all);
+	check_walk((struct ptrmap *)map, nr, all);
+
+	// delete one key in three, some twice
+	for (i = 0; i < nr; i += 3) {
+		check(test_map_delete(&map, &keys[i]) == &vals[i], "bad deletion", nr, i);
+		check(test_map_delete(&map, &keys[i]) == NULL, "deleted twice", nr, i);
+	}
+	check_lookups(map, nr, present);
+	check_walk((struct ptrmap *)map, nr, present);
+
+	// put them back
+	for (i = 0; i < nr; i += 3)
+		test_map_update(&map, &keys[i], &vals[i]);
+	check_lookups(map, nr, all);
+	check_walk((struct ptrmap *)map, nr, all);
+
+	// and delete everything, backward
+	for (i = nr; i-- > 0; )
+		check(test_map_delete(&map, &keys[i]) == &vals[i], "bad deletion", nr, i);
+	check_lookups(map, nr, none);
+	check_walk((struct ptrmap *)map, nr, none);
+
+	printf("map of %d: done\n", nr);
+}
+
+// an IR map, released with its arena
+static void test_ir_map(int nr)
+{
+	struct test_ir_map *map = NULL;
+	int i;
+
+	mark_ir_ptrmaps();
+	for (i = 0; i < nr; i++)
+		test_ir_map_add(&map, &keys[i], &vals[i]);
+	for (i = 0; i < nr; i += 3)
+		test_ir_map_delete(&map, &keys[i]);
+	for (i = 0; i < nr; i++) {
+		long *val = test_ir_map_lookup(map, &keys[i]);
+
+		check(val == (present(i) ? &vals[i] : NULL), "bad lookup", nr, i);
+	}
+	check_walk((struct ptrmap *)map, nr, present);
+	release_ir_ptrmaps();
+
+	printf("ir map of %d: done\n", nr);
+}
+
+int main(int argc, char **argv)
+{
+	// linear, just hashed, hashed, bigger than an allocation chunk
+	static const int sizes[] = { 6, 15, 300, NR_KEYS };
+	int i;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		test_map(sizes[i]);
+	test_ir_map(NR_KEYS);
+	return errors != 0;
+}
@@ -69,7 +69,12 @@ extern int *hash_stream(const char *name);
 
 struct ident {
 	struct ident *next;	/* Hash chain of identifiers */
-	struct symbol *symbols;	/* Pointer to semantic meaning list */
+	struct symbol *symbols;	/* Ordinary identifiers & typedefs */
+	struct symbol *tags;	/* Struct, union & enum tags */
+	struct symbol *labels;	/* Labels */
+	struct symbol *macros;	/* Macros, defined or #undef'ed */
+	struct symbol *keywords;/* Keywords & other internal names */
+	unsigned int hash;	/* Hash of the name */
 	unsigned char len;	/* Length of identifier name */
 	unsigned char tainted:1,
 	              reserved:1,
@@ -229,7 +234,11 @@ extern const char *quote_token(const struct token *);
 extern struct token * tokenize(const struct position *pos, const char *, int, struct token *, const char **next_path);
 extern struct token * tokenize_buffer(void *, unsigned long, struct token **);
 
+extern int token_cache;
+extern void show_token_cache_stats(void);
+
 extern void show_identifier_stats(void);
+extern void show_include_cache_stats(void);
 extern struct token *preprocess(struct token *);
 
 static inline int match_op(struct token *token, unsigned int op)
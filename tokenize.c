@@ -31,11 +31,20 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "lib.h"
 #include "allocate.h"
 #include "token.h"
 #include "symbol.h"
+#include "stats.h"
 
 #define EOF (-1)
 
@@ -299,7 +308,7 @@ const char *quote_token(const struct token *token)
 
 static int input_stream_hashes[HASHED_INPUT] = { [0 ... HASHED_INPUT-1] = -1 };
 
-int *hash_stream(const char *name)
+static uint32_t hash_path(const char *name)
 {
 	uint32_t hash = 0;
 	unsigned char c;
@@ -307,7 +316,13 @@ int *hash_stream(const char *name)
 	while ((c = *name++) != 0)
 		hash = (hash + (c << 4) + (c >> 4)) * 11;
 
-	hash *= HASH_PRIME;
+	return hash * HASH_PRIME;
+}
+
+int *hash_stream(const char *name)
+{
+	uint32_t hash = hash_path(name);
+
 	hash >>= 32 - HASHED_INPUT_BITS;
 	return input_stream_hashes + hash;
 }
@@ -370,6 +385,7 @@ repeat:
 		size = read(stream->fd, stream->buffer, BUFSIZE);
 		if (size <= 0)
 			goto got_eof;
+		stream->buffer[size] = '\0';	// the sentinel
 		stream->size = size;
 		stream->offset = offset = 0;
 	}
@@ -434,29 +450,120 @@ got_eof:
 	return EOF;
 }
 
+static const char special[256] = {
+	['\0'] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['\\'] = 1
+};
+
 /*
  *  We want that as light as possible while covering all normal cases.
  *  Slow path (including the logics with line-splicing and EOF sanity
  *  checks) is in nextchar_slow().
+ *  The buffer is always terminated by a '\0' sentinel, which is also
+ *  special, so there is no need to check for the end of the buffer here.
  */
 static inline int nextchar(stream_t *stream)
 {
 	int offset = stream->offset;
+	int c = stream->buffer[offset];
 
-	if (offset < stream->size) {
-		int c = stream->buffer[offset++];
-		static const char special[256] = {
-			['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['\\'] = 1
-		};
-		if (!special[c]) {
-			stream->offset = offset;
-			stream->pos++;
-			return c;
-		}
+	if (!special[c]) {
+		stream->offset = offset + 1;
+		stream->pos++;
+		return c;
 	}
 	return nextchar_slow(stream);
 }
 
+/*
+ * Scanners for the long runs of plain characters: they return the number
+ * of bytes, starting at 's', before the first one which is not part of
+ * the run. None of them accept a special char (see nextchar()) and so
+ * the buffer's sentinel always stops them.
+ *
+ * With SSE2, the buffer is scanned by aligned chunks of 16 bytes, but
+ * only while the whole chunk is within the buffer and its sentinel
+ * ('end'). The last partial chunk is scanned byte per byte.
+ */
+#define CHUNK_ALIGN	16
+
+#define scalar_span(s, end, stop) ({			\
+	const unsigned char *__p = (s);			\
+	while (!(stop(*__p)))				\
+		__p++;					\
+	__p - (s);					\
+})
+
+#ifdef __SSE2__
+#define vector_span(s, end, stop, vstop) ({			\
+	const unsigned char *__p = (s);				\
+	const unsigned char *__last = (end) - CHUNK_ALIGN;	\
+	size_t __n;						\
+	for (;;) {						\
+		if (!((uintptr_t)__p & (CHUNK_ALIGN - 1)) && __p <= __last) {\
+			__m128i __v = _mm_load_si128((const __m128i *)__p);	\
+			unsigned int __m = _mm_movemask_epi8(vstop(__v));	\
+			if (__m) {					\
+				__n = __p - (s) + __builtin_ctz(__m);	\
+				break;				\
+			}					\
+			__p += CHUNK_ALIGN;			\
+			continue;				\
+		}						\
+		if (stop(*__p)) {				\
+			__n = __p - (s);			\
+			break;					\
+		}						\
+		__p++;						\
+	}							\
+	__n;							\
+})
+
+#define vbyte(c)		_mm_set1_epi8(c)
+#define veq(v, c)		_mm_cmpeq_epi8(v, vbyte(c))
+#define vor(a, b)		_mm_or_si128(a, b)
+#define vnot(v)			_mm_xor_si128(v, vbyte(-1))
+
+#define vspecial(v)	vor(vor(veq(v, '\0'), veq(v, '\t')),		\
+			    vor(vor(veq(v, '\r'), veq(v, '\n')), veq(v, '\\')))
+#define vcomment(v)	vor(vspecial(v), veq(v, '*'))
+#define vspace(v)	vnot(veq(v, ' '))
+#else
+#define vector_span(s, end, stop, vstop)	scalar_span(s, end, stop)
+#endif
+
+#define is_special(c)		(special[c])
+#define is_comment_stop(c)	(special[c] || (c) == '*')
+#define is_not_space(c)		((c) != ' ')
+
+// the current position and the end of the buffer, sentinel included
+#define stream_span(stream, stop, vstop)				\
+	vector_span(stream->buffer + stream->offset,			\
+		    stream->buffer + stream->size + 1, stop, vstop)
+
+static inline size_t span_plain(stream_t *stream)
+{
+	return stream_span(stream, is_special, vspecial);
+}
+
+static inline size_t span_comment(stream_t *stream)
+{
+	return stream_span(stream, is_comment_stop, vcomment);
+}
+
+static inline size_t span_spaces(stream_t *stream)
+{
+	return stream_span(stream, is_not_space, vspace);
+}
+
+/*
+ * Skip a run of plain chars, updating the position in bulk.
+ */
+static inline void skip_chars(stream_t *stream, size_t n)
+{
+	stream->offset += n;
+	stream->pos += n;
+}
+
 struct token eof_token_entry;
 
 static struct token *mark_eof(stream_t *stream)
@@ -650,6 +757,7 @@ static int drop_stream_eoln(stream_t *stream)
 {
 	drop_token(stream);
 	for (;;) {
+		skip_chars(stream, span_plain(stream));
 		switch (nextchar(stream)) {
 		case EOF:
 			return EOF;
@@ -659,6 +767,23 @@ static int drop_stream_eoln(stream_t *stream)
 	}
 }
 
+/*
+ * Skip the chars of a comment that can't end it, including the
+ * plain newlines (CR & line-splicing are left to nextchar_slow()).
+ */
+static void skip_comment(stream_t *stream)
+{
+	for (;;) {
+		skip_chars(stream, span_comment(stream));
+		if (stream->buffer[stream->offset] != '\n')
+			return;
+		stream->offset++;
+		stream->line++;
+		stream->pos = 0;
+		stream->newline = 1;
+	}
+}
+
 static int drop_stream_comment(stream_t *stream)
 {
 	int newline;
@@ -673,6 +798,8 @@ static int drop_stream_comment(stream_t *stream)
 			warning(stream_pos(stream), "End of file in the middle of a comment");
 			return curr;
 		}
+		if (curr != '*')
+			skip_comment(stream);
 		next = nextchar(stream);
 		if (curr == '*' && next == '/')
 			break;
@@ -794,29 +921,95 @@ static int get_one_special(int c, stream_t *stream)
 	return next;
 }
 
+/*
+ * The identifiers' hash table.
+ *
+ * It's sized for a few thousand identifiers and doubled each time
+ * there are more identifiers than buckets. Each identifier keeps its
+ * full hash, so the table can be resized without hashing the names
+ * again and most mismatches are rejected without looking at the names.
+ */
 #define IDENT_HASH_BITS (13)
-#define IDENT_HASH_SIZE (1<<IDENT_HASH_BITS)
-#define IDENT_HASH_MASK (IDENT_HASH_SIZE-1)
+#define IDENT_PROBES	64
 
-#define ident_hash_init(c)		(c)
-#define ident_hash_add(oldhash,c)	((oldhash)*11 + (c))
-#define ident_hash_end(hash)		((((hash) >> IDENT_HASH_BITS) + (hash)) & IDENT_HASH_MASK)
-
-static struct ident *hash_table[IDENT_HASH_SIZE];
+static struct ident **hash_table;
+static unsigned int hash_size, hash_mask;
 static int ident_hit, ident_miss, idents;
+static unsigned long ident_probes[IDENT_PROBES];
+
+static void resize_ident_hash(unsigned int size)
+{
+	struct ident **table = calloc(size, sizeof(*table));
+	unsigned int i;
+
+	if (!table)
+		die("out of memory for the identifiers' hash table");
+
+	// keep the chains' order, like when they were created
+	for (i = 0; i < hash_size; i++) {
+		struct ident *ident, *next;
+
+		for (ident = hash_table[i]; ident; ident = next) {
+			struct ident **p = &table[ident->hash & (size - 1)];
+
+			next = ident->next;
+			while (*p)
+				p = &(*p)->next;
+			ident->next = NULL;
+			*p = ident;
+		}
+	}
+	free(hash_table);
+	hash_table = table;
+	hash_size = size;
+	hash_mask = size - 1;
+}
+
+static struct ident **ident_bucket(unsigned int hash)
+{
+	if (idents >= hash_size)
+		resize_ident_hash(hash_size ? hash_size * 2 : 1 << IDENT_HASH_BITS);
+	return &hash_table[hash & hash_mask];
+}
+
+static unsigned int percentile(const unsigned long *hist, int n, unsigned long total, int pct)
+{
+	unsigned long sum = 0;
+	int i;
+
+	for (i = 0; i < n - 1; i++) {
+		sum += hist[i];
+		if (sum * 100 >= total * pct)
+			break;
+	}
+	return i;
+}
 
 void show_identifier_stats(void)
 {
+	unsigned long lookups = 0;
 	int i;
 	int distribution[100];
 
 	fprintf(stderr, "identifiers: %d hits, %d misses\n",
 		ident_hit, ident_miss);
+	fprintf(stderr, "hash table: %d identifiers, %u buckets\n",
+		idents, hash_size);
+	for (i = 0; i < IDENT_PROBES; i++)
+		lookups += ident_probes[i];
+	if (lookups) {
+		fprintf(stderr, "probes: 50%%: %u, 90%%: %u, 99%%: %u, max: %u%s\n",
+			percentile(ident_probes, IDENT_PROBES, lookups, 50),
+			percentile(ident_probes, IDENT_PROBES, lookups, 90),
+			percentile(ident_probes, IDENT_PROBES, lookups, 99),
+			percentile(ident_probes, IDENT_PROBES, lookups, 100),
+			ident_probes[IDENT_PROBES - 1] ? "+" : "");
+	}
 
 	for (i = 0; i < 100; i++)
 		distribution[i] = 0;
 
-	for (i = 0; i < IDENT_HASH_SIZE; i++) {
+	for (i = 0; i < hash_size; i++) {
 		struct ident * ident = hash_table[i];
 		int count = 0;
 
@@ -839,39 +1032,51 @@ static struct ident *alloc_ident(const char *name, int len)
 {
 	struct ident *ident = __alloc_ident(len);
 	ident->symbols = NULL;
+	ident->tags = NULL;
+	ident->labels = NULL;
+	ident->macros = NULL;
+	ident->keywords = NULL;
 	ident->len = len;
 	ident->tainted = 0;
 	memcpy(ident->name, name, len);
 	return ident;
 }
 
-static struct ident * insert_hash(struct ident *ident, unsigned long hash)
+static struct ident * insert_hash(struct ident *ident, unsigned int hash)
 {
-	ident->next = hash_table[hash];
-	hash_table[hash] = ident;
+	struct ident **p = ident_bucket(hash);
+
+	ident->hash = hash;
+	ident->next = *p;
+	*p = ident;
 	ident_miss++;
+	idents++;
 	return ident;
 }
 
-static struct ident *create_hashed_ident(const char *name, int len, unsigned long hash)
+static struct ident *create_hashed_ident(const char *name, int len, unsigned int hash)
 {
 	struct ident *ident;
 	struct ident **p;
+	int probes = 0;
 
-	p = &hash_table[hash];
+	p = ident_bucket(hash);
 	while ((ident = *p) != NULL) {
-		if (ident->len == (unsigned char) len) {
-			if (strncmp(name, ident->name, len) != 0)
+		probes++;
+		if (ident->hash == hash && ident->len == (unsigned char) len) {
+			if (memcmp(name, ident->name, len) != 0)
 				goto next;
 
+			ident_probes[probes < IDENT_PROBES ? probes : IDENT_PROBES - 1]++;
 			ident_hit++;
 			return ident;
 		}
 next:
-		//misses++;
 		p = &ident->next;
 	}
+	ident_probes[probes < IDENT_PROBES ? probes : IDENT_PROBES - 1]++;
 	ident = alloc_ident(name, len);
+	ident->hash = hash;
 	*p = ident;
 	ident->next = NULL;
 	ident_miss++;
@@ -879,17 +1084,48 @@ next:
 	return ident;
 }
 
-static unsigned long hash_name(const char *name, int len)
+/*
+ * Hash the name a word at a time: each word is mixed in with a
+ * multiplication and the high half folded back into the low one,
+ * since only the low bits are used to index the table.
+ */
+#define HASH_MULT	0x9e3779b97f4a7c15ULL
+
+static inline uint64_t hash_mix(uint64_t hash, uint64_t word)
+{
+	hash = (hash ^ word) * HASH_MULT;
+	return hash ^ (hash >> 32);
+}
+
+#define CONTENT_SEED	0xcbf29ce484222325ULL
+#define CHECK_SEED	0x84222325cbf29ce4ULL
+
+/*
+ * The options changing the diagnostics issued by the tokenizer.
+ * Files are only stored if they were tokenized without any diagnostic,
+ * so these options are part of the key: a file stored while a warning
+ * was disabled must not be loaded when this warning is enabled.
+ */
+static uint32_t token_file_options(void)
+{
+	return Wnewline_eof ? 1 : 0;
+}
+
+static unsigned int hash_name(const char *name, int len)
 {
-	unsigned long hash;
-	const unsigned char *p = (const unsigned char *)name;
+	uint64_t hash = len;
+	uint64_t word;
 
-	hash = ident_hash_init(*p++);
-	while (--len) {
-		unsigned int i = *p++;
-		hash = ident_hash_add(hash, i);
+	for (; len >= 8; len -= 8, name += 8) {
+		memcpy(&word, name, 8);
+		hash = hash_mix(hash, word);
 	}
-	return ident_hash_end(hash);
+	if (len) {
+		word = 0;
+		memcpy(&word, name, len);
+		hash = hash_mix(hash, word);
+	}
+	return hash_mix(hash, 0);
 }
 
 struct ident *hash_ident(struct ident *ident)
@@ -918,20 +1154,29 @@ static int get_one_identifier(int c, stream_t *stream)
 {
 	struct token *token;
 	struct ident *ident;
-	unsigned long hash;
 	char buf[256];
+	const unsigned char *p;
 	int len = 1;
-	int next;
+	int next, n;
 
-	hash = ident_hash_init(c);
 	buf[0] = c;
+
+	// the bulk of the identifier, straight from the buffer
+	p = stream->buffer + stream->offset;
+	for (n = 0; len < sizeof(buf); n++) {
+		int c = p[n];
+		if (!(cclass[c + 1] & (Letter | Digit)))
+			break;
+		buf[len++] = c;
+	}
+	skip_chars(stream, n);
+
 	for (;;) {
 		next = nextchar(stream);
 		if (!(cclass[next + 1] & (Letter | Digit)))
 			break;
 		if (len >= sizeof(buf))
 			break;
-		hash = ident_hash_add(hash, next);
 		buf[len] = next;
 		len++;
 	};
@@ -945,8 +1190,7 @@ static int get_one_identifier(int c, stream_t *stream)
 							TOKEN_WIDE_STRING);
 		}
 	}
-	hash = ident_hash_end(hash);
-	ident = create_hashed_ident(buf, len, hash);
+	ident = create_hashed_ident(buf, len, hash_name(buf, len));
 
 	/* Pass it on.. */
 	token = stream->token;
@@ -1002,26 +1246,579 @@ static struct token *tokenize_stream(stream_t *stream)
 			continue;
 		}
 		stream->whitespace = 1;
+		skip_chars(stream, span_spaces(stream));
 		c = nextchar(stream);
 	}
 	return mark_eof(stream);
 }
 
+/*
+ * Note: buffer[size] must be readable and be '\0', like for a C string.
+ */
 struct token * tokenize_buffer(void *buffer, unsigned long size, struct token **endtoken)
 {
 	stream_t stream;
 	struct token *begin;
 
+	phase_start(PHASE_TOKENIZE);
 	begin = setup_stream(&stream, 0, -1, buffer, size);
 	*endtoken = tokenize_stream(&stream);
+	phase_end(PHASE_TOKENIZE);
+	return begin;
+}
+
+/*
+ * Regular files are mapped as a whole instead of being read by chunks.
+ * The mapping is followed by (at least) one page of zeroes, so that
+ * the buffer is always terminated by the needed sentinel.
+ */
+static unsigned char *map_file(int fd, size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t len = (size + page) & ~(page - 1);
+	unsigned char *map;
+
+	if (!size || size >= (1U << 31))
+		return NULL;
+	map = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+	if (mmap(map, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(map, len);
+		return NULL;
+	}
+	return map;
+}
+
+static void unmap_file(unsigned char *map, size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	munmap(map, (size + page) & ~(page - 1));
+}
+
+/*
+ * Cache of the raw tokens of the included files.
+ *
+ * When several files are checked in the same run, only the tokens are
+ * dropped after each file, the idents, numbers and strings they point
+ * to are kept. So, the tokens of an included file can be saved here,
+ * outside of the token allocator, and simply be copied back the next
+ * time the same, unchanged, file is included.
+ * Files for which the tokenizer issued some diagnostic are not cached.
+ */
+int token_cache = 0;
+
+#define TOKEN_CACHE_BITS (10)
+#define TOKEN_CACHE_SIZE (1 << TOKEN_CACHE_BITS)
+
+struct cached_stream {
+	struct cached_stream *next;
+	const char *name;
+	time_t mtime;
+	off_t size;
+	unsigned int nr;
+	struct token tokens[];
+};
+
+static struct cached_stream *cached_streams[TOKEN_CACHE_SIZE];
+static int cache_hits, cache_misses, cache_files;
+static unsigned long cache_tokens;
+
+static struct cached_stream **cached_stream_hash(const char *name)
+{
+	return cached_streams + (hash_path(name) >> (32 - TOKEN_CACHE_BITS));
+}
+
+static struct cached_stream *lookup_cached_stream(const char *name, const struct stat *st)
+{
+	struct cached_stream *cache;
+
+	for (cache = *cached_stream_hash(name); cache; cache = cache->next) {
+		if (strcmp(cache->name, name))
+			continue;
+		if (cache->mtime != st->st_mtime || cache->size != st->st_size)
+			continue;
+		cache_hits++;
+		return cache;
+	}
+	cache_misses++;
+	return NULL;
+}
+
+static void save_cached_stream(const char *name, const struct stat *st, struct token *begin, struct token *end)
+{
+	struct cached_stream *cache, **head;
+	struct token *token;
+	unsigned int nr = 1;
+
+	for (token = begin; token != end; token = token->next)
+		nr++;
+
+	cache = malloc(sizeof(*cache) + nr * sizeof(struct token));
+	if (!cache)
+		return;
+	cache->name = name;
+	cache->mtime = st->st_mtime;
+	cache->size = st->st_size;
+	cache->nr = nr;
+	for (token = begin, nr = 0; ; token = token->next) {
+		switch (token_type(token)) {
+		case TOKEN_STRING:
+		case TOKEN_WIDE_STRING:
+			// will be shared: it must not be cannibalized
+			token->string->immutable = 1;
+			break;
+		default:
+			break;
+		}
+		cache->tokens[nr] = *token;
+		cache->tokens[nr++].next = NULL;
+		if (token == end)
+			break;
+	}
+
+	head = cached_stream_hash(name);
+	cache->next = *head;
+	*head = cache;
+	cache_files++;
+	cache_tokens += nr;
+}
+
+static struct token *replay_cached_stream(struct cached_stream *cache, int idx, struct token **endtoken)
+{
+	struct token *begin, **list = &begin;
+	struct token *token = NULL;
+	unsigned int i;
+
+	for (i = 0; i < cache->nr; i++) {
+		token = __alloc_token(0);
+		*token = cache->tokens[i];
+		token->pos.stream = idx;
+		*list = token;
+		list = &token->next;
+	}
+
+	// the last one is the TOKEN_STREAMEND, see mark_eof()
+	eof_token_entry.pos = token->pos;
+	token_type(&eof_token_entry) = TOKEN_EOF;
+	eof_token_entry.next = &eof_token_entry;
+	token->next = &eof_token_entry;
+	*endtoken = token;
+	return begin;
+}
+
+/*
+ * On-disk cache of the raw tokens of the included files
+ * (-ftoken-cache-dir=<dir>).
+ *
+ * The tokens of each included file are saved in a binary file named
+ * after a hash of the file's content, so that later runs can map it
+ * and skip the tokenization of unchanged files. Such a file contains:
+ *	- a header, with the options it depends on and a second hash
+ *	  of the content,
+ *	- the tokens: their position and a 32-bit value,
+ *	- the idents used by these tokens, as offsets into the data,
+ *	- the data: the idents' names, the numbers and the strings.
+ * The value of a token is an index in the idents for identifiers,
+ * an offset into the data for numbers and strings, and the value
+ * itself for specials and small character constants.
+ * The idents are re-hashed once per file when loading it, while the
+ * numbers and strings are used directly from the (private) mapping,
+ * which is never unmapped.
+ */
+#define TOKEN_FILE_MAGIC	0x43545053	// "SPTC"
+#define TOKEN_FILE_VERSION	2
+
+struct token_file_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t tabstop;
+	uint32_t options;
+	uint32_t file_size;
+	uint32_t nr_tokens;
+	uint32_t nr_idents;
+	uint32_t data_size;
+	uint64_t check;
+};
+
+struct token_file_entry {
+	struct position pos;
+	uint32_t value;
+};
+
+static int disk_hits, disk_misses, disk_stores;
+
+static uint64_t hash_content(const unsigned char *buf, size_t size, uint64_t hash)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		uint64_t w;
+
+		memcpy(&w, buf + i, 8);
+		hash = (hash ^ w) * 0x100000001b3ULL;
+		hash ^= hash >> 29;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ buf[i]) * 0x100000001b3ULL;
+	return hash ^ (hash >> 32);
+}
+
+static int write_file(int fd, const void *buf, size_t size)
+{
+	const char *p = buf;
+
+	while (size) {
+		ssize_t n = write(fd, p, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 0;
+		p += n;
+		size -= n;
+	}
+	return 1;
+}
+
+static struct token *load_token_file(const char *path, int idx, size_t file_size, uint64_t check, struct token **endtoken)
+{
+	const struct token_file_header *hdr;
+	const struct token_file_entry *entries;
+	const uint32_t *offsets;
+	struct ident **idents = NULL;
+	struct token *begin = NULL, **list = &begin;
+	struct token *token = NULL;
+	unsigned char *map, *data;
+	struct stat st;
+	size_t size;
+	unsigned int i;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return NULL;
+	}
+	size = st.st_size;
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	hdr = (void *)map;
+	if (hdr->magic != TOKEN_FILE_MAGIC || hdr->version != TOKEN_FILE_VERSION)
+		goto bad;
+	if (hdr->tabstop != tabstop || hdr->options != token_file_options())
+		goto bad;
+	if (hdr->file_size != file_size || hdr->check != check)
+		goto bad;
+	if (hdr->nr_tokens < 2 || hdr->nr_tokens > size / sizeof(*entries))
+		goto bad;
+	if (hdr->nr_idents > size / sizeof(*offsets))
+		goto bad;
+	if (size != sizeof(*hdr) + hdr->nr_tokens * sizeof(*entries) +
+			hdr->nr_idents * sizeof(*offsets) + hdr->data_size)
+		goto bad;
+	entries = (void *)(hdr + 1);
+	offsets = (void *)(entries + hdr->nr_tokens);
+	data = (void *)(offsets + hdr->nr_idents);
+
+	idents = malloc(hdr->nr_idents * sizeof(*idents) + 1);
+	if (!idents)
+		goto bad;
+	for (i = 0; i < hdr->nr_idents; i++) {
+		uint32_t off = offsets[i];
+		const char *name;
+		int len;
+
+		if (off >= hdr->data_size || data[off] == 0 || data[off] > hdr->data_size - off - 1)
+			goto bad;
+		len = data[off];
+		name = (const char *)data + off + 1;
+		idents[i] = create_hashed_ident(name, len, hash_name(name, len));
+	}
+
+	for (i = 0; i < hdr->nr_tokens; i++) {
+		const struct token_file_entry *entry = &entries[i];
+		uint32_t val = entry->value;
+
+		token = __alloc_token(0);
+		token->pos = entry->pos;
+		token->pos.stream = idx;
+		switch (token_type(token)) {
+		case TOKEN_IDENT:
+			if (val >= hdr->nr_idents)
+				goto bad;
+			token->ident = idents[val];
+			break;
+		case TOKEN_NUMBER:
+			if (val >= hdr->data_size || !memchr(data + val, 0, hdr->data_size - val))
+				goto bad;
+			token->number = (const char *)data + val;
+			break;
+		case TOKEN_CHAR:
+		case TOKEN_WIDE_CHAR:
+		case TOKEN_STRING:
+		case TOKEN_WIDE_STRING:
+			if (val % __alignof__(struct string) ||
+			    val + sizeof(struct string) > hdr->data_size)
+				goto bad;
+			token->string = (struct string *)(data + val);
+			if (token->string->length > hdr->data_size - val - sizeof(struct string))
+				goto bad;
+			break;
+		case TOKEN_CHAR_EMBEDDED_0 ... TOKEN_CHAR_EMBEDDED_3:
+		case TOKEN_WIDE_CHAR_EMBEDDED_0 ... TOKEN_WIDE_CHAR_EMBEDDED_3:
+			memcpy(token->embedded, &val, 4);
+			break;
+		case TOKEN_SPECIAL:
+			token->special = val;
+			break;
+		case TOKEN_STREAMBEGIN:
+			if (i != 0)
+				goto bad;
+			break;
+		case TOKEN_STREAMEND:
+			if (i != hdr->nr_tokens - 1)
+				goto bad;
+			break;
+		default:
+			goto bad;
+		}
+		*list = token;
+		list = &token->next;
+	}
+	if (token_type(begin) != TOKEN_STREAMBEGIN || token_type(token) != TOKEN_STREAMEND)
+		goto bad;
+	free(idents);
+
+	// see mark_eof()
+	eof_token_entry.pos = token->pos;
+	token_type(&eof_token_entry) = TOKEN_EOF;
+	eof_token_entry.next = &eof_token_entry;
+	token->next = &eof_token_entry;
+	*endtoken = token;
+	disk_hits++;
+	return begin;
+
+bad:
+	// the tokens already allocated are simply lost
+	free(idents);
+	munmap(map, size);
+	return NULL;
+}
+
+/*
+ * Simple pointer -> index hash table, used to give a unique index
+ * to each of the idents of the stored file.
+ */
+struct ident_index {
+	struct ident *ident;
+	uint32_t index;
+};
+
+static uint32_t ident_index(struct ident_index *table, unsigned int mask, struct ident *ident, uint32_t *nr)
+{
+	unsigned long h = ((unsigned long)ident >> 4) * HASH_PRIME;
+
+	for (;; h++) {
+		struct ident_index *entry = &table[h & mask];
+		if (entry->ident == ident)
+			return entry->index;
+		if (!entry->ident) {
+			entry->ident = ident;
+			entry->index = (*nr)++;
+			return entry->index;
+		}
+	}
+}
+
+static void store_token_file(const char *path, struct token *begin, struct token *end, size_t file_size, uint64_t check)
+{
+	struct token_file_header hdr = {
+		.magic = TOKEN_FILE_MAGIC,
+		.version = TOKEN_FILE_VERSION,
+		.tabstop = tabstop,
+		.options = token_file_options(),
+		.file_size = file_size,
+		.check = check,
+	};
+	struct token_file_entry *entries = NULL;
+	struct ident_index *table = NULL;
+	uint32_t *offsets = NULL;
+	unsigned char *data = NULL;
+	size_t data_size = 0, data_alloc = 0;
+	unsigned int nr = 1, mask, i;
+	struct token *token;
+	char *tmp;
+	int fd;
+
+	for (token = begin; token != end; token = token->next)
+		nr++;
+	for (mask = 15; mask < 2 * nr; mask = mask * 2 + 1)
+		;
+
+	entries = malloc(nr * sizeof(*entries));
+	table = calloc(mask + 1, sizeof(*table));
+	if (!entries || !table)
+		goto out;
+
+	// the entries and the data
+	for (token = begin, i = 0; i < nr; token = token->next, i++) {
+		struct token_file_entry *entry = &entries[i];
+		const void *src = NULL;
+		size_t len = 0, align = 1;
+
+		entry->pos = token->pos;
+		entry->pos.stream = 0;
+		entry->value = 0;
+		switch (token_type(token)) {
+		case TOKEN_IDENT:
+			entry->value = ident_index(table, mask, token->ident, &hdr.nr_idents);
+			break;
+		case TOKEN_NUMBER:
+			src = token->number;
+			len = strlen(token->number) + 1;
+			break;
+		case TOKEN_CHAR:
+		case TOKEN_WIDE_CHAR:
+		case TOKEN_STRING:
+		case TOKEN_WIDE_STRING:
+			src = token->string;
+			len = sizeof(struct string) + token->string->length;
+			align = __alignof__(struct string);
+			break;
+		case TOKEN_CHAR_EMBEDDED_0 ... TOKEN_CHAR_EMBEDDED_3:
+		case TOKEN_WIDE_CHAR_EMBEDDED_0 ... TOKEN_WIDE_CHAR_EMBEDDED_3:
+			memcpy(&entry->value, token->embedded, 4);
+			break;
+		case TOKEN_SPECIAL:
+			entry->value = token->special;
+			break;
+		default:
+			break;
+		}
+		if (!len)
+			continue;
+
+		data_size = (data_size + align - 1) & ~(align - 1);
+		if (data_size + len > data_alloc) {
+			data_alloc = (data_size + len) * 2;
+			data = realloc(data, data_alloc);
+			if (!data)
+				goto out;
+		}
+		memcpy(data + data_size, src, len);
+		if (align > 1)	// shared with all users: see get_string_constant()
+			((struct string *)(data + data_size))->immutable = 1;
+		entry->value = data_size;
+		data_size += len;
+	}
+
+	// the idents' names, prefixed by their length
+	offsets = malloc(hdr.nr_idents * sizeof(*offsets) + 1);
+	if (!offsets)
+		goto out;
+	for (i = 0; i <= mask; i++) {
+		struct ident *ident = table[i].ident;
+
+		if (!ident)
+			continue;
+		if (data_size + ident->len + 1 > data_alloc) {
+			data_alloc = (data_size + ident->len + 1) * 2;
+			data = realloc(data, data_alloc);
+			if (!data)
+				goto out;
+		}
+		offsets[table[i].index] = data_size;
+		data[data_size++] = ident->len;
+		memcpy(data + data_size, ident->name, ident->len);
+		data_size += ident->len;
+	}
+	hdr.nr_tokens = nr;
+	hdr.data_size = data_size;
+
+	// write it in a temporary file, then atomically replace the old one
+	tmp = xasprintf("%s.%d", path, getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		goto out;
+	if (write_file(fd, &hdr, sizeof(hdr)) &&
+	    write_file(fd, entries, nr * sizeof(*entries)) &&
+	    write_file(fd, offsets, hdr.nr_idents * sizeof(*offsets)) &&
+	    write_file(fd, data, data_size) &&
+	    close(fd) == 0 && rename(tmp, path) == 0) {
+		disk_stores++;
+		goto out;
+	}
+	unlink(tmp);
+
+out:
+	free(entries);
+	free(table);
+	free(offsets);
+	free(data);
+}
+
+static struct token *tokenize_cached_file(int idx, int fd, const struct stat *st, struct token **endtoken)
+{
+	struct token *begin = NULL;
+	unsigned char *buf;
+	size_t size = st->st_size;
+	char path[PATH_MAX];
+	stream_t stream;
+	unsigned int diags;
+	uint64_t check;
+
+	// the file is mapped as a whole, to hash its content
+	buf = map_file(fd, size);
+	if (!buf)
+		return NULL;
+
+	// the content's hash & the options make the key, a second hash
+	// of the content is stored in the file to check it on loading
+	snprintf(path, sizeof(path), "%s/%016llx-%zx-%x.tok", ftoken_cache_dir,
+		(unsigned long long)hash_content(buf, size, CONTENT_SEED), size,
+		token_file_options());
+	check = hash_content(buf, size, CHECK_SEED);
+	begin = load_token_file(path, idx, size, check, endtoken);
+	if (begin)
+		goto out;
+
+	disk_misses++;
+	diags = diag_count;
+	begin = setup_stream(&stream, idx, -1, buf, size);
+	*endtoken = tokenize_stream(&stream);
+	if (diags == diag_count)
+		store_token_file(path, begin, *endtoken, size, check);
+out:
+	unmap_file(buf, size);
 	return begin;
 }
 
+void show_token_cache_stats(void)
+{
+	if (token_cache)
+		fprintf(stderr, "token cache: %d files, %lu tokens, %d hits, %d misses\n",
+			cache_files, cache_tokens, cache_hits, cache_misses);
+	if (ftoken_cache_dir)
+		fprintf(stderr, "token cache dir: %d hits, %d misses, %d stores\n",
+			disk_hits, disk_misses, disk_stores);
+}
+
 struct token * tokenize(const struct position *pos, const char *name, int fd, struct token *endtoken, const char **next_path)
 {
 	struct token *begin, *end;
 	stream_t stream;
-	unsigned char buffer[BUFSIZE];
+	unsigned char buffer[BUFSIZE + 1];
+	unsigned char *map = NULL;
+	unsigned int diags = diag_count;
+	int cacheable = 0;
+	struct stat st;
+	int regular;
 	int idx;
 
 	idx = init_stream(pos, name, fd, next_path);
@@ -1030,9 +1827,45 @@ struct token * tokenize(const struct position *pos, const char *name, int fd, st
 		return endtoken;
 	}
 
-	begin = setup_stream(&stream, idx, fd, buffer, 0);
+	phase_start(PHASE_TOKENIZE);
+	regular = !fstat(fd, &st) && S_ISREG(st.st_mode);
+
+	// only included files are cached
+	if (pos && regular && (token_cache || ftoken_cache_dir)) {
+		if (token_cache) {
+			struct cached_stream *cache = lookup_cached_stream(name, &st);
+
+			if (cache) {
+				begin = replay_cached_stream(cache, idx, &end);
+				goto out;
+			}
+			cacheable = 1;
+		}
+		if (ftoken_cache_dir) {
+			begin = tokenize_cached_file(idx, fd, &st, &end);
+			if (begin)
+				goto save;
+		}
+	}
+
+	// pipes & co. are read by chunks
+	if (regular)
+		map = map_file(fd, st.st_size);
+	if (map) {
+		begin = setup_stream(&stream, idx, -1, map, st.st_size);
+	} else {
+		buffer[0] = '\0';	// the sentinel
+		begin = setup_stream(&stream, idx, fd, buffer, 0);
+	}
 	end = tokenize_stream(&stream);
+	if (map)
+		unmap_file(map, st.st_size);
+save:
+	if (cacheable && diags == diag_count)
+		save_cached_stream(name, &st, begin, end);
+out:
 	if (endtoken)
 		end->next = endtoken;
+	phase_end(PHASE_TOKENIZE);
 	return begin;
 }
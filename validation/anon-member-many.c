@@ -0,0 +1,34 @@
+struct s {
+	int m00, m01, m02, m03, m04, m05, m06, m07;
+	int m08, m09, m10, m11, m12, m13, m14, m15;
+	union {
+		int u;
+		struct {
+			char a;
+			int b;
+		};
+	};
+	int last;
+};
+
+_Static_assert(__builtin_offsetof(struct s, m15) == 60, "m15");
+_Static_assert(__builtin_offsetof(struct s, u) == 64, "u");
+_Static_assert(__builtin_offsetof(struct s, a) == 64, "a");
+_Static_assert(__builtin_offsetof(struct s, b) == 68, "b");
+_Static_assert(__builtin_offsetof(struct s, last) == 72, "last");
+
+static struct s s = { .b = 1, .last = 2, };
+
+int foo(struct s *p)
+{
+	return p->m07 + p->b + p->last + p->none;
+}
+
+/*
+ * check-name: anon-member-many
+ * check-description: member lookup in structs with many members
+ *
+ * check-error-start
+anon-member-many.c:24:43: error: no member 'none' in struct s
+ * check-error-end
+ */
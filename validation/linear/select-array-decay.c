@@ -0,0 +1,21 @@
+static int a[2], b[2];
+
+int *sel(int c)
+{
+	return c ? a : b;
+}
+
+/*
+ * check-name: select-array-decay
+ * check-command: test-linearize -Wno-decl $file
+ *
+ * check-output-start
+sel:
+.L0:
+	<entry-point>
+	select.64   %r4 <- %arg1, a, b
+	ret.64      %r4
+
+
+ * check-output-end
+ */
@@ -0,0 +1,24 @@
+int fun(int);
+
+int foo(int a, int b)
+{
+	int x;
+
+	x = fun(a);
+	if (b)
+		x = fun(x);
+	fun(0);			// x is dead here
+
+	x = fun(b);
+	if (a)
+		x = b;
+	return x;
+}
+
+/*
+ * check-name: pruned-phi
+ * check-description: no phi-nodes are inserted where the variable is dead
+ * check-command: test-linearize -Wno-decl -fdump-ir=mem2reg $file
+ * check-output-ignore
+ * check-output-pattern(1): phi\\.
+ */
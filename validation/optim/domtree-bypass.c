@@ -0,0 +1,44 @@
+struct node {
+	int nr;
+	int size;
+	struct node *next;
+};
+
+struct node *alloc_node(int size);
+int add(struct node **head);
+
+int add(struct node **head)
+{
+	struct node *list = *head;
+	struct node *last = (void *)0;
+	int nr = 0;
+
+	if (list) {
+		last = list->next;
+		nr = last->nr;
+	}
+	if (!list || nr >= last->size) {
+		struct node *new;
+		if (!list) {
+			new = alloc_node(0);
+			*head = new;
+		} else {
+			new = alloc_node(1);
+			last->next = new;
+		}
+		last = new;
+		nr = 0;
+	}
+	nr++;
+	last->nr = nr;
+	return nr;
+}
+
+/*
+ * check-name: domtree-bypass
+ * check-description:
+ *	When a block is bypassed, the blocks it dominated
+ *	must all be handed over to its dominator before any
+ *	of them is moved deeper in the tree.
+ * check-command: sparse -vir $file
+ */
@@ -0,0 +1,24 @@
+int foo(int a)
+{
+	int x = 1, y = 0;
+	int i;
+
+	for (i = 0; i < a; i++) {
+		if (x == 1)
+			y = 2;
+		else
+			y = a;
+		x = 2 - x + (y - 2);
+	}
+	return x;
+}
+
+/*
+ * check-name: sccp-loop
+ * check-command: test-linearize -Wno-decl $file
+ *
+ * check-output-ignore
+ * check-output-excludes: select\\.
+ * check-output-excludes: phi\\..*(x)
+ * check-output-contains: ret\\.32 *\\$1
+ */
@@ -0,0 +1,20 @@
+int var;
+
+int fun(void)
+{
+	return var;
+}
+
+/*
+ * check-name: parallel-jobs
+ * check-command: sparse -j 2 $file $file $file
+ *
+ * check-error-start
+parallel-jobs.c:1:5: warning: symbol 'var' was not declared. Should it be static?
+parallel-jobs.c:3:5: warning: symbol 'fun' was not declared. Should it be static?
+parallel-jobs.c:1:5: warning: symbol 'var' was not declared. Should it be static?
+parallel-jobs.c:3:5: warning: symbol 'fun' was not declared. Should it be static?
+parallel-jobs.c:1:5: warning: symbol 'var' was not declared. Should it be static?
+parallel-jobs.c:3:5: warning: symbol 'fun' was not declared. Should it be static?
+ * check-error-end
+ */
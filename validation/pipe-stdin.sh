@@ -0,0 +1,10 @@
+#!/bin/sh
+#
+# pipe-stdin.sh file [sparse options ...]
+#
+# Run sparse on a file given on its standard input via a pipe, so that
+# the file is read by chunks and not mapped.
+
+file="$1"
+shift
+cat "$file" | "$(dirname "$0")/../sparse" "$@" -
@@ -0,0 +1,20 @@
+#include <hdr.h>
+#include <hdr.h>
+
+/*
+ * check-name: include-cache
+ * check-description: the absent headers are remembered, also for #include_next
+ * check-command: sparse -E -I preprocessor/include-cache/none -I preprocessor/include-cache/inc1 -I preprocessor/include-cache/inc2 $file $file
+ *
+ * check-output-start
+
+inc1: "preprocessor/include-cache/inc1/hdr.h"
+inc2: "preprocessor/include-cache/inc2/hdr.h"
+inc1: "preprocessor/include-cache/inc1/hdr.h"
+inc2: "preprocessor/include-cache/inc2/hdr.h"
+inc1: "preprocessor/include-cache/inc1/hdr.h"
+inc2: "preprocessor/include-cache/inc2/hdr.h"
+inc1: "preprocessor/include-cache/inc1/hdr.h"
+inc2: "preprocessor/include-cache/inc2/hdr.h"
+ * check-output-end
+ */
@@ -0,0 +1,2 @@
+inc1: __FILE__
+#include_next <hdr.h>
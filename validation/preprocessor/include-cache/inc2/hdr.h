@@ -0,0 +1 @@
+inc2: __FILE__
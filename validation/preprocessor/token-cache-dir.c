@@ -0,0 +1,29 @@
+#include "a.h"
+#include "b.h"
+
+static int a = A;
+static int b = B;
+
+/*
+ * check-name: token-cache-dir
+ * check-command: validation/token-cache-dir.sh $file
+ *
+ * check-output-start
+cold:
+token cache dir: 0 hits, 2 misses, 2 stores
+warm:
+token cache dir: 2 hits, 0 misses, 0 stores
+warning enabled:
+b.h:1:11: warning: no newline at end of file
+token cache dir: 0 hits, 2 misses, 1 stores
+warning enabled, again:
+b.h:1:11: warning: no newline at end of file
+token cache dir: 1 hits, 1 misses, 0 stores
+changed header:
+token cache dir: 1 hits, 1 misses, 1 stores
+truncated cache:
+token cache dir: 0 hits, 2 misses, 2 stores
+rebuilt cache:
+token cache dir: 2 hits, 0 misses, 0 stores
+ * check-output-end
+ */
@@ -0,0 +1,9 @@
+#include "token-cache-string.h"
+
+_Static_assert(sizeof(str) == 6, "string modified");
+
+/*
+ * check-name: token-cache-string
+ * check-description: the strings of the cached tokens must not be modified
+ * check-command: sparse $file $file
+ */
@@ -0,0 +1 @@
+static const char str[] = "a\\x41";
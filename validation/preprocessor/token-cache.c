@@ -0,0 +1,19 @@
+#include "token-cache.h"
+#include "token-cache.h"
+cached(c)
+
+/*
+ * check-name: token-cache
+ * check-description: the included files' tokens are reused between files
+ * check-command: sparse -E $file $file
+ *
+ * check-output-start
+
+"preprocessor/token-cache.h" h 5
+"preprocessor/token-cache.h" h 5
+"preprocessor/token-cache.c" c 3
+"preprocessor/token-cache.h" h 5
+"preprocessor/token-cache.h" h 5
+"preprocessor/token-cache.c" c 3
+ * check-output-end
+ */
@@ -0,0 +1,5 @@
+#ifndef TOKEN_CACHE_H
+#define TOKEN_CACHE_H
+#define cached(x)	__FILE__ x __LINE__
+#endif
+cached(h)
@@ -0,0 +1,13 @@
+/*
+ * check-name: ptrmap
+ * check-description: grow, walk & delete from the pointer maps
+ * check-command: test-ptrmap
+ *
+ * check-output-start
+map of 6: done
+map of 15: done
+map of 300: done
+map of 5000: done
+ir map of 5000: done
+ * check-output-end
+ */
@@ -0,0 +1,20 @@
+#ifndef SERVED
+#error "not checked by the server"
+#endif
+
+#if FOO != 1
+#error "FOO is not 1"
+#endif
+
+int foo = FOO;
+
+/*
+ * check-name: server-request
+ * check-command: validation/server.sh $file
+ *
+ * check-output-start
+direct: 0
+client: 0
+server-request.c:9:5: warning: symbol 'foo' was not declared. Should it be static?
+ * check-output-end
+ */
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# server.sh file
+#
+# Check a file via a server (--server & --client) and compare the result
+# with a direct run. The server is started with -DSERVED=1, which must
+# thus be given to the direct run, while the request adds -DFOO=1.
+
+file="$1"
+sparse="$(dirname "$0")/../sparse"
+dir=$(mktemp -d) || exit 1
+sock="$dir/socket"
+
+"$sparse" --server="$sock" -DSERVED=1 > /dev/null 2>&1 &
+server=$!
+trap 'kill $server; wait $server; rm -rf "$dir"' EXIT
+
+tries=0
+while [ ! -S "$sock" ]; do
+	tries=$((tries + 1))
+	if [ $tries -gt 100 ]; then
+		echo "no server"
+		exit 1
+	fi
+	sleep 0.1
+done
+
+"$sparse" -DSERVED=1 -DFOO=1 "$file" > "$dir/direct" 2>&1
+echo "direct: $?"
+"$sparse" --client="$sock" -DFOO=1 "$file" > "$dir/client" 2>&1
+echo "client: $?"
+cat "$dir/client"
+diff -u "$dir/direct" "$dir/client"
@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# token-cache-dir.sh file
+#
+# Check the on-disk token cache (-ftoken-cache-dir): run sparse several
+# times on a copy of the file, which must include "a.h" & "b.h", while
+# changing these headers, the options and the cache itself, and show
+# the resulting diagnostics and the statistics of the cache.
+
+file="$1"
+sparse="$(cd "$(dirname "$0")/.." && pwd)/sparse"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+mkdir "$dir/cache"
+cp "$file" "$dir/main.c"
+printf '#define A 1\n' > "$dir/a.h"
+printf '#define B 2' > "$dir/b.h"		# no newline at end of file
+
+run()
+{
+	echo "$1:"
+	shift
+	(cd "$dir" && "$sparse" -ftoken-cache-dir=cache -fmem-report "$@" main.c 2>&1) |
+		grep -e 'warning:' -e 'error:' -e '^token cache dir:'
+}
+
+run "cold" -Wno-newline-eof
+run "warm" -Wno-newline-eof
+run "warning enabled"
+run "warning enabled, again"
+
+printf '#define A 3\n' > "$dir/a.h"
+run "changed header" -Wno-newline-eof
+
+for tok in "$dir"/cache/*.tok; do
+	printf 'SPTC' > "$tok"
+done
+run "truncated cache" -Wno-newline-eof
+run "rebuilt cache" -Wno-newline-eof